@@ -0,0 +1,116 @@
+#ifndef BACKGROUND_BUILD_HPP
+#define BACKGROUND_BUILD_HPP
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <exception>
+
+using namespace std;
+
+/*
+ * Runs one expensive build on its own thread as soon as it is created. The body reports its
+ * progress with setTotal()/advance(), the foreground polls it with progress() and ready(), and
+ * wait() blocks only if the structure is still being built. The structure the body writes must
+ * not be touched by other threads until wait() returns.
+ */
+class BackgroundBuild {
+    string name;
+    atomic<unsigned long long> done{0};
+    atomic<unsigned long long> total{0};
+    atomic<bool> finished{false};
+    mutex lock;
+    condition_variable completed;
+    exception_ptr failure;
+    double buildSeconds = 0;
+    thread worker;
+
+    void work(function<void(BackgroundBuild&)> body) {
+        auto start = chrono::steady_clock::now();
+        try {
+            body(*this);
+        } catch (...) {
+            failure = current_exception();
+        }
+        buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        lock_guard<mutex> guard(lock);
+        finished.store(true, memory_order_release);
+        completed.notify_all();
+    }
+
+public:
+    BackgroundBuild(const string& name, function<void(BackgroundBuild&)> body) : name(name) {
+        worker = thread(&BackgroundBuild::work, this, std::move(body));
+    }
+
+    ~BackgroundBuild() {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    BackgroundBuild(const BackgroundBuild&) = delete;
+    BackgroundBuild& operator=(const BackgroundBuild&) = delete;
+
+    // Called by the body: units of work in total and units finished so far
+    void setTotal(unsigned long long units) {
+        total.store(units, memory_order_relaxed);
+    }
+
+    void advance(unsigned long long units = 1) {
+        done.fetch_add(units, memory_order_relaxed);
+    }
+
+    const string& label() const {
+        return name;
+    }
+
+    bool ready() const {
+        return finished.load(memory_order_acquire);
+    }
+
+    // Fraction of the work done, between 0 and 1
+    double progress() const {
+        if (ready()) {
+            return 1.0;
+        }
+        unsigned long long units = total.load(memory_order_relaxed);
+        return units == 0 ? 0.0 : min(1.0, (double)done.load(memory_order_relaxed) / units);
+    }
+
+    // Build time in seconds, valid once ready
+    double seconds() const {
+        return buildSeconds;
+    }
+
+    // Blocks until the build ends, printing the progress to `out` every `interval` while waiting,
+    // and rethrows the exception of the body if it failed
+    void wait(ostream& out, chrono::milliseconds interval = chrono::milliseconds(500)) {
+        {
+            unique_lock<mutex> guard(lock);
+            while (!finished.load(memory_order_acquire)) {
+                if (!completed.wait_for(guard, interval, [&]() { return finished.load(memory_order_acquire); })) {
+                    ios::fmtflags flags = out.flags();
+                    streamsize precision = out.precision();
+                    out << "Construyendo " << name << "... " << fixed << setprecision(0) << progress() * 100 << "%" << endl;
+                    out.flags(flags);
+                    out.precision(precision);
+                }
+            }
+        }
+        if (worker.joinable()) {
+            worker.join();
+        }
+        if (failure) {
+            rethrow_exception(failure);
+        }
+    }
+};
+
+#endif
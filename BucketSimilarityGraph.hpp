@@ -0,0 +1,197 @@
+#ifndef BUCKET_SIMILARITY_GRAPH_HPP
+#define BUCKET_SIMILARITY_GRAPH_HPP
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <string>
+#include "WeightedUndirectedGraph.hpp"
+
+using namespace std;
+
+/*
+ * Implicit version of the similarity graph.
+ *
+ * With calculateSimilarity and the 0.6 threshold two books are adjacent exactly when they share
+ * at least two of (author, genre, publication date). The edge set is then the union of the
+ * cliques formed by the (author, genre), (author, date) and (genre, date) groups, so it is enough
+ * to store which three groups each book belongs to. Neighbors are enumerated by merging the
+ * three member lists: a book found in one of them shares two attributes (similarity 0.6) and a
+ * book found in all three shares the three of them (similarity 0.9). Memory is O(n) instead of
+ * O(edges) and the results are the same as the explicit Graph, in ascending book order.
+ */
+class BucketSimilarityGraph {
+    static const int RELATIONS = 3;   // (author, genre), (author, date), (genre, date)
+
+    vector<string> titles;                          // Title of each book, by index
+    unordered_map<string, int> titleIndex;          // Title -> index of the book
+    vector<vector<int>> groupMembers;               // Books of each group, in ascending order
+    vector<int> memberships;                        // RELATIONS groups per book
+    unordered_map<string, int> groupIds[RELATIONS]; // Group key -> group id, per relation
+
+    int groupFor(int relation, const string& key) {
+        auto it = groupIds[relation].find(key);
+        if (it != groupIds[relation].end()) {
+            return it->second;
+        }
+        int id = (int)groupMembers.size();
+        groupIds[relation].emplace(key, id);
+        groupMembers.emplace_back();
+        return id;
+    }
+
+    static void groupKeys(const Libro& libro, string keys[RELATIONS]) {
+        const char SEP = '\x1f';  // Separator that does not appear in the CSV fields
+        keys[0] = libro.author + SEP + libro.genre;
+        keys[1] = libro.author + SEP + libro.publication_date;
+        keys[2] = libro.genre + SEP + libro.publication_date;
+    }
+
+    // Merges the member lists of the three groups of a book, leaving out `exclude`
+    static vector<pair<int, double>> mergeGroups(const vector<int>* lists[RELATIONS], int exclude) {
+        vector<pair<int, double>> result;
+        size_t pos[RELATIONS] = {0, 0, 0};
+
+        while (true) {
+            // Smallest pending index among the three lists and how many lists contain it
+            int next = -1;
+            for (int r = 0; r < RELATIONS; ++r) {
+                if (pos[r] < lists[r]->size() && (next == -1 || (*lists[r])[pos[r]] < next)) {
+                    next = (*lists[r])[pos[r]];
+                }
+            }
+            if (next == -1) {
+                break;
+            }
+
+            int count = 0;
+            for (int r = 0; r < RELATIONS; ++r) {
+                if (pos[r] < lists[r]->size() && (*lists[r])[pos[r]] == next) {
+                    ++pos[r];
+                    ++count;
+                }
+            }
+
+            if (next != exclude) {
+                // Same sums as calculateSimilarity, so the weights are bit-identical
+                double similarity = (count == RELATIONS) ? 0.3 + 0.3 + 0.3 : 0.3 + 0.3;
+                result.emplace_back(next, 1.0 - similarity);
+            }
+        }
+
+        return result;
+    }
+
+public:
+    // Adds a book with the next index. Books must be added in index order.
+    void addBook(const Libro& libro) {
+        int index = (int)titles.size();
+        titles.push_back(libro.title);
+        titleIndex.emplace(libro.title, index);
+
+        string keys[RELATIONS];
+        groupKeys(libro, keys);
+        for (int r = 0; r < RELATIONS; ++r) {
+            int group = groupFor(r, keys[r]);
+            groupMembers[group].push_back(index);
+            memberships.push_back(group);
+        }
+    }
+
+    // Replaces the attributes of a book already in the graph, moving it to its new groups
+    void updateBook(int index, const Libro& libro) {
+        if (titles[index] != libro.title) {
+            auto it = titleIndex.find(titles[index]);
+            if (it != titleIndex.end() && it->second == index) {
+                titleIndex.erase(it);
+            }
+            titles[index] = libro.title;
+            titleIndex.emplace(libro.title, index);
+        }
+
+        string keys[RELATIONS];
+        groupKeys(libro, keys);
+        for (int r = 0; r < RELATIONS; ++r) {
+            int oldGroup = memberships[index * RELATIONS + r];
+            int newGroup = groupFor(r, keys[r]);
+            if (newGroup == oldGroup) {
+                continue;
+            }
+            // Member lists stay sorted so that neighbors() can merge them
+            vector<int>& from = groupMembers[oldGroup];
+            from.erase(lower_bound(from.begin(), from.end(), index));
+            vector<int>& to = groupMembers[newGroup];
+            to.insert(lower_bound(to.begin(), to.end(), index), index);
+            memberships[index * RELATIONS + r] = newGroup;
+        }
+    }
+
+    // Takes a book out of its groups; its index is not reused and it is no longer anyone's neighbor
+    void removeBook(int index) {
+        auto it = titleIndex.find(titles[index]);
+        if (it != titleIndex.end() && it->second == index) {
+            titleIndex.erase(it);
+        }
+        titles[index].clear();
+        for (int r = 0; r < RELATIONS; ++r) {
+            vector<int>& members = groupMembers[memberships[index * RELATIONS + r]];
+            auto position = lower_bound(members.begin(), members.end(), index);
+            if (position != members.end() && *position == index) {
+                members.erase(position);
+            }
+        }
+    }
+
+    template <typename Container>
+    void build(const Container& libros) {
+        for (unsigned int i = 0; i < libros.size(); ++i) {
+            addBook(libros[i]);
+        }
+    }
+
+    int size() const {
+        return (int)titles.size();
+    }
+
+    // Returns (neighbor index, weight) pairs in ascending index order, with weight = 1 - similarity
+    vector<pair<int, double>> neighbors(int book) const {
+        const vector<int>* lists[RELATIONS];
+        for (int r = 0; r < RELATIONS; ++r) {
+            lists[r] = &groupMembers[memberships[book * RELATIONS + r]];
+        }
+        return mergeGroups(lists, book);
+    }
+
+    // Same as neighbors() for a book that does not have to be in the graph
+    vector<pair<int, double>> similarTo(const Libro& libro) const {
+        static const vector<int> none;
+        string keys[RELATIONS];
+        groupKeys(libro, keys);
+        const vector<int>* lists[RELATIONS];
+        for (int r = 0; r < RELATIONS; ++r) {
+            auto it = groupIds[r].find(keys[r]);
+            lists[r] = it != groupIds[r].end() ? &groupMembers[it->second] : &none;
+        }
+        return mergeGroups(lists, -1);
+    }
+
+    void displayAdjacent(const string& book) const {
+        auto it = titleIndex.find(book);
+        vector<pair<int, double>> adjacent;
+        if (it != titleIndex.end()) {
+            adjacent = neighbors(it->second);
+        }
+
+        if (!adjacent.empty()) {
+            cout << "Libros adyacentes a \"" << book << "\":" << endl;
+            for (const auto& neighbor : adjacent) {
+                cout << " - " << titles[neighbor.first] << " (peso: " << neighbor.second << ")" << endl;
+            }
+        } else {
+            cout << "El libro \"" << book << "\" no tiene libros adyacentes o no esta en el grafo." << endl;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,461 @@
+#ifndef CATALOG_FOLLOWER_HPP
+#define CATALOG_FOLLOWER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <iomanip>
+#include <stdexcept>
+#include "KeyValueAVLTree.hpp"
+#include "BucketSimilarityGraph.hpp"
+#include "CatalogReader.hpp"
+#include "CatalogWal.hpp"
+
+using namespace std;
+
+/*
+ * The indexes of a follower, updated one mutation at a time. Every book gets a slot that is never
+ * reused; a removed book is taken out of the indexes and of the graph and its slot stays dead.
+ */
+class FollowerCatalog {
+    vector<Libro> slots;
+    KeyValueAVLTree<int, int> slotOfId;
+    KeyValueAVLTree<string, vector<int>> titles;                    // Title -> slots of its books, by id
+    KeyValueAVLTree<string, unordered_map<int, Libro>> genres;      // Genre -> books by id
+    BucketSimilarityGraph graph;
+    size_t count = 0;
+
+    void index(int slot) {
+        const Libro& libro = slots[slot];
+        KeyValueAVLNode<string, vector<int>>* title = titles.find(libro.title);
+        if (title) {
+            vector<int>& sameTitle = title->value;
+            auto position = lower_bound(sameTitle.begin(), sameTitle.end(), libro.id,
+                                        [&](int s, int id) { return slots[s].id < id; });
+            sameTitle.insert(position, slot);
+        } else {
+            titles.insert(libro.title, vector<int>(1, slot));
+        }
+
+        KeyValueAVLNode<string, unordered_map<int, Libro>>* genre = genres.find(libro.genre);
+        if (genre) {
+            genre->value[libro.id] = libro;
+        } else {
+            unordered_map<int, Libro> books;
+            books[libro.id] = libro;
+            genres.insert(libro.genre, books);
+        }
+    }
+
+    void unindex(int slot) {
+        const Libro& libro = slots[slot];
+        KeyValueAVLNode<string, vector<int>>* title = titles.find(libro.title);
+        if (title) {
+            vector<int>& sameTitle = title->value;
+            sameTitle.erase(std::remove(sameTitle.begin(), sameTitle.end(), slot), sameTitle.end());
+            if (sameTitle.empty()) {
+                titles.erase(libro.title);
+            }
+        }
+
+        KeyValueAVLNode<string, unordered_map<int, Libro>>* genre = genres.find(libro.genre);
+        if (genre) {
+            genre->value.erase(libro.id);
+            if (genre->value.empty()) {
+                genres.erase(libro.genre);
+            }
+        }
+    }
+
+public:
+    void upsert(const Libro& libro) {
+        KeyValueAVLNode<int, int>* existing = slotOfId.find(libro.id);
+        if (existing) {
+            int slot = existing->value;
+            unindex(slot);
+            slots[slot] = libro;
+            graph.updateBook(slot, libro);
+            index(slot);
+            return;
+        }
+        int slot = (int)slots.size();
+        slots.push_back(libro);
+        slotOfId.insert(libro.id, slot);
+        graph.addBook(libro);
+        index(slot);
+        ++count;
+    }
+
+    void remove(int id) {
+        KeyValueAVLNode<int, int>* existing = slotOfId.find(id);
+        if (!existing) {
+            return;
+        }
+        int slot = existing->value;
+        unindex(slot);
+        graph.removeBook(slot);
+        slotOfId.erase(id);
+        --count;
+    }
+
+    void apply(const Mutation& mutation) {
+        if (mutation.type == MutationType::Remove) {
+            remove(mutation.libro.id);
+        } else if (mutation.type != MutationType::Checkpoint) {
+            upsert(mutation.libro);
+        }
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Books with the same title resolve to the one with the lowest id, as in the leader's title tree
+    bool findTitle(const string& title, Libro& libro) const {
+        KeyValueAVLNode<string, vector<int>>* node = titles.find(title);
+        if (!node) {
+            return false;
+        }
+        libro = slots[node->value.front()];
+        return true;
+    }
+
+    vector<Libro> booksInGenre(const string& genre) const {
+        vector<Libro> books;
+        KeyValueAVLNode<string, unordered_map<int, Libro>>* node = genres.find(genre);
+        if (node) {
+            for (const auto& entry : node->value) {
+                books.push_back(entry.second);
+            }
+        }
+        sort(books.begin(), books.end(), [](const Libro& a, const Libro& b) { return a.id < b.id; });
+        return books;
+    }
+
+    // Neighbors of the book with that title in id order, which is the leader's catalog order
+    vector<pair<Libro, double>> similar(const string& title) const {
+        vector<pair<Libro, double>> neighbors;
+        KeyValueAVLNode<string, vector<int>>* node = titles.find(title);
+        if (node) {
+            for (const auto& neighbor : graph.neighbors(node->value.front())) {
+                neighbors.emplace_back(slots[neighbor.first], neighbor.second);
+            }
+        }
+        sort(neighbors.begin(), neighbors.end(),
+             [](const pair<Libro, double>& a, const pair<Libro, double>& b) { return a.first.id < b.first.id; });
+        return neighbors;
+    }
+};
+
+/*
+ * Read replica of a CatalogStore directory. It loads the leader's snapshot and then tails its
+ * write-ahead log from a background thread, applying each record to its own indexes.
+ *
+ * LSNs only grow, so a record at or below the last applied one is skipped and one further ahead
+ * means the log was truncated by a checkpoint before the follower read it: the follower then
+ * reloads the snapshot, which holds everything before the checkpoint record. A truncation is
+ * noticed because the first record of the log changes. A follower that needs longer to load the
+ * snapshot than the leader takes between checkpoints only catches up when the writes slow down.
+ *
+ * A read waits while the follower has not reached the end of the log for longer than
+ * `maxStaleness`, and fails if it still has not after that long, so a successful read never
+ * misses a mutation committed more than `maxStaleness` before it.
+ */
+class CatalogFollower {
+    string snapshotPath;
+    string walPath;
+    chrono::milliseconds pollInterval;
+    chrono::milliseconds maxStaleness;
+
+    mutable shared_mutex stateLock;
+    unique_ptr<FollowerCatalog> state;
+
+    // Tail position, only used by the tailing thread
+    unsigned long long offset = sizeof(WAL_MAGIC);
+    unsigned long long epoch = 0;           // LSN of the first record of the log when it was read
+    unsigned long long applied = 0;         // Every mutation up to this LSN is in the indexes
+
+    mutable mutex metricsLock;
+    mutable condition_variable progress;
+    chrono::steady_clock::time_point caughtUpAt;
+    bool caughtUp = false;
+    bool stopping = false;
+    unsigned long long recordsApplied = 0;
+    double applySeconds = 0;
+    unsigned long long resyncs = 0;
+    unsigned long long lastBehind = 0;      // Records still to apply when the last poll started
+    unsigned long long maxBehind = 0;
+    vector<double> lagSamples;              // Append to apply, milliseconds, most recent last
+    string lastError;
+    chrono::steady_clock::time_point started;
+    thread tailer;
+
+    // Reads one record at the current position of `in`, with `available` bytes of the file left
+    // from there; false if it is incomplete or corrupt
+    static bool readRecord(ifstream& in, unsigned long long available, unsigned long long& lsn, Mutation& mutation,
+                           unsigned long long& appendedAt, unsigned long long& length) {
+        string payload;
+        return wal_detail::readRecord(in, available, payload, length) &&
+               wal_detail::decode(payload, lsn, mutation, &appendedAt);
+    }
+
+    unsigned long long firstLsn() const {
+        ifstream in(walPath, ios::binary);
+        char magic[sizeof(WAL_MAGIC)];
+        unsigned long long lsn = 0, appendedAt, length;
+        Mutation mutation;
+        if (!in.read(magic, sizeof(magic)) || memcmp(magic, WAL_MAGIC, sizeof(magic)) != 0) {
+            return 0;
+        }
+        unsigned long long size = wal_detail::fileSize(in, sizeof(magic));
+        if (size < sizeof(magic) || !readRecord(in, size - sizeof(magic), lsn, mutation, appendedAt, length)) {
+            return 0;
+        }
+        return lsn;
+    }
+
+    /*
+     * Rebuilds the indexes from the snapshot and starts reading the log from its beginning. The
+     * snapshot is renamed into place before the log is truncated, so if the log starts with
+     * checkpoint C the snapshot read afterwards holds every mutation before C; otherwise the log
+     * was never truncated and holds everything after the seed. A newer snapshot only means some
+     * records are applied twice, which upserts and deletes by id make harmless.
+     */
+    void loadSnapshot() {
+        unsigned long long first = firstLsn();
+        unique_ptr<FollowerCatalog> fresh(new FollowerCatalog());
+        ifstream snapshot(snapshotPath);
+        if (!snapshot) {
+            throw runtime_error("No se pudo abrir el snapshot " + snapshotPath);
+        }
+        string line;
+        while (getline(snapshot, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty()) {
+                fresh->upsert(parseLibro(line));
+            }
+        }
+
+        {
+            unique_lock<shared_mutex> guard(stateLock);
+            state.swap(fresh);
+        }
+        epoch = first;
+        offset = sizeof(WAL_MAGIC);
+        applied = first > 0 ? first - 1 : 0;
+    }
+
+    // Applies every complete record past the current position; returns false if a snapshot reload is needed
+    bool poll() {
+        // Everything in the log at this moment is applied when the poll returns true
+        auto pollStart = chrono::steady_clock::now();
+        ifstream in(walPath, ios::binary);
+        char magic[sizeof(WAL_MAGIC)];
+        if (!in.read(magic, sizeof(magic)) || memcmp(magic, WAL_MAGIC, sizeof(magic)) != 0) {
+            // The leader has not created the log yet, so the snapshot is the whole catalog
+            lock_guard<mutex> guard(metricsLock);
+            lastBehind = 0;
+            caughtUpAt = pollStart;
+            caughtUp = true;
+            progress.notify_all();
+            return true;
+        }
+        in.close();
+
+        unsigned long long first = firstLsn();
+        if (first != epoch) {
+            epoch = first;
+            offset = sizeof(WAL_MAGIC);
+        }
+
+        struct Entry {
+            unsigned long long lsn;
+            Mutation mutation;
+            unsigned long long appendedAt;
+        };
+        vector<Entry> batch;
+        unsigned long long end = offset;
+        in.open(walPath, ios::binary);
+        unsigned long long size = wal_detail::fileSize(in, offset);
+        Entry entry;
+        unsigned long long length;
+        while (end < size && readRecord(in, size - end, entry.lsn, entry.mutation, entry.appendedAt, length)) {
+            batch.push_back(entry);
+            end += length;
+        }
+
+        unsigned long long behind = 0;
+        for (const Entry& record : batch) {
+            if (record.lsn > applied) {
+                ++behind;
+            }
+        }
+
+        auto applyStart = chrono::steady_clock::now();
+        vector<double> lags;
+        unsigned long long count = 0;
+        {
+            unique_lock<shared_mutex> guard(stateLock);
+            for (const Entry& record : batch) {
+                if (record.lsn <= applied) {
+                    continue;
+                }
+                if (record.lsn != applied + 1) {
+                    return false;
+                }
+                state->apply(record.mutation);
+                applied = record.lsn;
+                if (record.mutation.type != MutationType::Checkpoint) {
+                    ++count;
+                    if (record.appendedAt > 0) {
+                        lags.push_back((wal_detail::nowMicros() - (double)record.appendedAt) / 1000.0);
+                    }
+                }
+            }
+        }
+        offset = end;
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - applyStart).count();
+
+        lock_guard<mutex> guard(metricsLock);
+        recordsApplied += count;
+        applySeconds += seconds;
+        lastBehind = behind;
+        maxBehind = max(maxBehind, behind);
+        lagSamples.insert(lagSamples.end(), lags.begin(), lags.end());
+        if (lagSamples.size() > 100000) {
+            lagSamples.erase(lagSamples.begin(), lagSamples.begin() + (lagSamples.size() - 100000));
+        }
+        caughtUpAt = pollStart;
+        caughtUp = true;
+        progress.notify_all();
+        return true;
+    }
+
+    void tail() {
+        while (true) {
+            try {
+                if (!poll()) {
+                    loadSnapshot();
+                    lock_guard<mutex> guard(metricsLock);
+                    ++resyncs;
+                    continue;
+                }
+            } catch (const exception& e) {
+                lock_guard<mutex> guard(metricsLock);
+                lastError = e.what();
+            }
+            unique_lock<mutex> guard(metricsLock);
+            if (progress.wait_for(guard, pollInterval, [&]() { return stopping; })) {
+                return;
+            }
+        }
+    }
+
+    // Blocks while the follower is staler than allowed, up to that same bound
+    void awaitFresh() const {
+        unique_lock<mutex> guard(metricsLock);
+        auto fresh = [&]() { return caughtUp && chrono::steady_clock::now() - caughtUpAt <= maxStaleness; };
+        if (!progress.wait_for(guard, maxStaleness, fresh)) {
+            throw runtime_error("La replica no alcanza al lider desde hace mas de " +
+                                to_string(maxStaleness.count()) + " ms" +
+                                (lastError.empty() ? "" : " (" + lastError + ")"));
+        }
+    }
+
+    static double percentile(vector<double> samples, double fraction) {
+        if (samples.empty()) {
+            return 0;
+        }
+        size_t rank = (size_t)(fraction * (samples.size() - 1) + 0.5);
+        nth_element(samples.begin(), samples.begin() + rank, samples.end());
+        return samples[rank];
+    }
+
+public:
+    CatalogFollower(const string& directory, chrono::milliseconds pollInterval = chrono::milliseconds(10),
+                    chrono::milliseconds maxStaleness = chrono::milliseconds(1000))
+        : snapshotPath(directory + "/catalogo.snapshot.csv"), walPath(directory + "/catalogo.wal"),
+          pollInterval(pollInterval), maxStaleness(maxStaleness) {
+        started = chrono::steady_clock::now();
+        loadSnapshot();
+        tailer = thread(&CatalogFollower::tail, this);
+    }
+
+    ~CatalogFollower() {
+        {
+            lock_guard<mutex> guard(metricsLock);
+            stopping = true;
+        }
+        progress.notify_all();
+        tailer.join();
+    }
+
+    CatalogFollower(const CatalogFollower&) = delete;
+    CatalogFollower& operator=(const CatalogFollower&) = delete;
+
+    bool findTitle(const string& title, Libro& libro) const {
+        awaitFresh();
+        shared_lock<shared_mutex> guard(stateLock);
+        return state->findTitle(title, libro);
+    }
+
+    vector<Libro> booksInGenre(const string& genre) const {
+        awaitFresh();
+        shared_lock<shared_mutex> guard(stateLock);
+        return state->booksInGenre(genre);
+    }
+
+    vector<pair<Libro, double>> similar(const string& title) const {
+        awaitFresh();
+        shared_lock<shared_mutex> guard(stateLock);
+        return state->similar(title);
+    }
+
+    size_t size() const {
+        shared_lock<shared_mutex> guard(stateLock);
+        return state->size();
+    }
+
+    // Waits until every record in the log when this is called has been applied
+    void sync() const {
+        unique_lock<mutex> guard(metricsLock);
+        auto requested = chrono::steady_clock::now();
+        progress.wait(guard, [&]() { return stopping || (caughtUp && caughtUpAt > requested); });
+    }
+
+    void printMetrics(ostream& out) const {
+        lock_guard<mutex> guard(metricsLock);
+        ios::fmtflags flags = out.flags();
+        streamsize precision = out.precision();
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        double staleness = caughtUp ? chrono::duration<double, milli>(chrono::steady_clock::now() - caughtUpAt).count() : -1;
+        out << fixed << setprecision(1)
+            << "Replica: " << recordsApplied << " mutaciones aplicadas, " << resyncs << " recargas del snapshot\n"
+            << "  aplicacion: " << setprecision(0) << (applySeconds > 0 ? recordsApplied / applySeconds : 0.0)
+            << " mutaciones/s de trabajo, " << (elapsed > 0 ? recordsApplied / elapsed : 0.0) << " mutaciones/s en promedio\n"
+            << setprecision(1)
+            << "  retraso (escritura en el lider -> aplicada): p50 " << percentile(lagSamples, 0.50) << " ms, p99 "
+            << percentile(lagSamples, 0.99) << " ms, max "
+            << (lagSamples.empty() ? 0.0 : *max_element(lagSamples.begin(), lagSamples.end())) << " ms\n"
+            << "  registros pendientes al sondear: ultimo " << lastBehind << ", maximo " << maxBehind
+            << "; ultima vez al dia hace " << staleness << " ms (limite " << maxStaleness.count() << " ms)\n";
+        if (!lastError.empty()) {
+            out << "  ultimo error: " << lastError << "\n";
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+#endif
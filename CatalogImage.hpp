@@ -0,0 +1,1043 @@
+#ifndef CATALOG_IMAGE_HPP
+#define CATALOG_IMAGE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <set>
+#include <map>
+#include <limits>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+#include "BucketSimilarityGraph.hpp"
+#include "CatalogWal.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/*
+ * Base image of the catalog (catalogo.base), mapped in memory and read in place:
+ *
+ *   ImageHeader        magic "SRIMG01", identifier of this base, counts and section offsets
+ *   ImageBook[n]       books in ascending id order; text fields are ranges of the strings section
+ *   uint32[n]          rows of the books in (title, id) order
+ *   ImageGenre[g]      genres in name order, each a range of the next section
+ *   uint32[n]          rows of the books of each genre, in id order
+ *   uint64[n + 1]      first adjacency entry of each book
+ *   uint32[m]          neighbor rows, ascending within each book
+ *   double[m]          weight of each entry, 1 - similarity, as in BucketSimilarityGraph
+ *   char[s]            strings
+ *
+ * Every section starts at an offset multiple of 8 recorded in the header.
+ *
+ * Delta (catalogo.delta.<sequence>), what changed since the base and the deltas before it:
+ *
+ *   char[8]            magic "SRDLT01"
+ *   uint64             identifier of the base, sequence number starting at 1
+ *   uint32             payload length, CRC-32 of the payload, then the payload:
+ *   uint32 count       books added or changed: id, title, author, genre, rating, pages, date, publisher
+ *   uint32 count       ids of removed books
+ *   uint32 count       title index entries: title, id, uint8 present
+ *   uint32 count       genre index entries: genre, id, uint8 present
+ *   uint32 count       adjacency rows of the added or changed books: id, uint32 count, then
+ *                      (int32 neighbor id, double weight) each
+ */
+const char IMAGE_MAGIC[8] = "SRIMG01";
+const char DELTA_MAGIC[8] = "SRDLT01";
+
+struct ImageHeader {
+    char magic[8];
+    unsigned long long base;
+    unsigned long long books;
+    unsigned long long genres;
+    unsigned long long entries;
+    unsigned long long stringBytes;
+    unsigned long long section[8];
+};
+
+struct ImageBook {
+    int id;
+    int pages;
+    float rating;
+    unsigned int reserved;
+    unsigned int offset[5];     // Title, author, genre, publication date, publisher
+    unsigned int length[5];
+};
+
+struct ImageGenre {
+    unsigned int name;          // Range of the strings section
+    unsigned int nameLength;
+    unsigned int first;         // Range of the genre rows section
+    unsigned int count;
+};
+
+/*
+ * Catalog served from a base image plus a chain of deltas.
+ *
+ * Opening maps the base and overlays the deltas in order: changed books, the complete id set
+ * of every title and genre a delta touched, and the adjacency rows it replaced, so the cost
+ * grows with the size of the deltas and not with the catalog. commit() compares a catalog
+ * with the current view and writes only the difference as the next delta. Its adjacency rows
+ * are only those of the changed books: the graph is symmetric, so the rows of their old and new
+ * neighbors are patched from them when the delta is overlaid. Once the chain is
+ * longer than `maxDeltas` or the deltas add up to more than `compactRatio` times the base,
+ * compact() folds everything into a new base without recomputing any similarity.
+ *
+ * Files are written to a temporary name, synced and renamed. A crash after a compaction
+ * renamed the new base leaves deltas of the previous one, which are recognized by the base
+ * identifier and deleted.
+ */
+class CatalogImage {
+    enum Section { BOOKS, TITLES, GENRES, GENRE_ROWS, ADJ_OFFSETS, ADJ_TARGETS, ADJ_WEIGHTS, STRINGS };
+    enum Field { TITLE, AUTHOR, GENRE, DATE, PUBLISHER };
+    static constexpr double REMOVED_EDGE = -1;   // Weights are 1 - similarity, never negative
+
+    struct Delta {
+        vector<Libro> books;
+        vector<int> removed;
+        vector<pair<string, pair<int, bool>>> titles;
+        vector<pair<string, pair<int, bool>>> genres;
+        vector<pair<int, vector<pair<int, double>>>> rows;
+    };
+
+    string directory;
+    size_t maxDeltas;
+    double compactRatio;
+
+    // Mapped base
+    const unsigned char* mapped = nullptr;
+    size_t mappedLength = 0;
+    const ImageHeader* header = nullptr;
+    const ImageBook* books = nullptr;
+    const unsigned int* titleRows = nullptr;
+    const ImageGenre* genreTable = nullptr;
+    const unsigned int* genreRows = nullptr;
+    const unsigned long long* adjOffsets = nullptr;
+    const unsigned int* adjTargets = nullptr;
+    const double* adjWeights = nullptr;
+    const char* strings = nullptr;
+
+    // Overlay of the deltas
+    unordered_map<int, Libro> changedBooks;
+    unordered_set<int> removedBooks;
+    unordered_map<string, set<int>> titleOverlay;   // Every id of each title a delta touched
+    unordered_map<string, set<int>> genreOverlay;
+    unordered_map<int, vector<pair<int, double>>> rowOverlay;   // Rows of changed books: neighbor ids, ascending
+    unordered_map<int, map<int, double>> rowPatches;            // Other rows: neighbor id -> weight or REMOVED_EDGE
+    size_t count = 0;
+    unsigned long long nextSequence = 1;
+    size_t deltaBytes = 0;
+    double mapSeconds = 0;
+    double overlaySeconds = 0;
+
+    string basePath() const {
+        return directory + "/catalogo.base";
+    }
+
+    string deltaPath(unsigned long long sequence) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/catalogo.delta.%06llu", sequence);
+        return directory + name;
+    }
+
+    static void syncPath(const string& path) {
+#if defined(__linux__)
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0 || fsync(fd) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw runtime_error("No se pudo sincronizar " + path);
+        }
+        close(fd);
+#else
+        (void)path;
+#endif
+    }
+
+    void publish(const string& temporary, const string& path) {
+        syncPath(temporary);
+        if (rename(temporary.c_str(), path.c_str()) != 0) {
+            throw runtime_error("No se pudo reemplazar " + path);
+        }
+        syncPath(directory);
+    }
+
+    // Compares a range of the strings section with `value`, in the same order as string::compare
+    int compareText(unsigned int offset, unsigned int length, const string& value) const {
+        int c = memcmp(strings + offset, value.data(), min<size_t>(length, value.size()));
+        if (c != 0) {
+            return c;
+        }
+        return length < value.size() ? -1 : (length > value.size() ? 1 : 0);
+    }
+
+    string text(unsigned int row, Field field) const {
+        return string(strings + books[row].offset[field], books[row].length[field]);
+    }
+
+    Libro baseBook(unsigned int row) const {
+        Libro libro;
+        libro.id = books[row].id;
+        libro.title = text(row, TITLE);
+        libro.author = text(row, AUTHOR);
+        libro.genre = text(row, GENRE);
+        libro.average_rating = books[row].rating;
+        libro.num_page = books[row].pages;
+        libro.publication_date = text(row, DATE);
+        libro.publisher = text(row, PUBLISHER);
+        return libro;
+    }
+
+    // Row of a book in the base, or -1
+    long long baseRow(int id) const {
+        if (!header) {
+            return -1;
+        }
+        const ImageBook* end = books + header->books;
+        const ImageBook* found = lower_bound(books, end, id, [](const ImageBook& b, int value) { return b.id < value; });
+        return found != end && found->id == id ? found - books : -1;
+    }
+
+    vector<int> baseTitleIds(const string& title) const {
+        vector<int> ids;
+        if (!header) {
+            return ids;
+        }
+        const unsigned int* end = titleRows + header->books;
+        const unsigned int* first = lower_bound(titleRows, end, title, [&](unsigned int row, const string& value) {
+            return compareText(books[row].offset[TITLE], books[row].length[TITLE], value) < 0;
+        });
+        for (const unsigned int* row = first;
+             row != end && compareText(books[*row].offset[TITLE], books[*row].length[TITLE], title) == 0; ++row) {
+            ids.push_back(books[*row].id);
+        }
+        return ids;
+    }
+
+    vector<int> baseGenreIds(const string& genre) const {
+        vector<int> ids;
+        if (!header) {
+            return ids;
+        }
+        const ImageGenre* end = genreTable + header->genres;
+        const ImageGenre* found = lower_bound(genreTable, end, genre, [&](const ImageGenre& g, const string& value) {
+            return compareText(g.name, g.nameLength, value) < 0;
+        });
+        if (found != end && compareText(found->name, found->nameLength, genre) == 0) {
+            for (unsigned int i = found->first; i < found->first + found->count; ++i) {
+                ids.push_back(books[genreRows[i]].id);
+            }
+        }
+        return ids;
+    }
+
+    bool lookup(int id, Libro& libro) const {
+        if (removedBooks.count(id)) {
+            return false;
+        }
+        auto changed = changedBooks.find(id);
+        if (changed != changedBooks.end()) {
+            libro = changed->second;
+            return true;
+        }
+        long long row = baseRow(id);
+        if (row < 0) {
+            return false;
+        }
+        libro = baseBook((unsigned int)row);
+        return true;
+    }
+
+    // Neighbor ids and weights of a book of the current view, in ascending id order
+    vector<pair<int, double>> rowOf(int id) const {
+        auto replaced = rowOverlay.find(id);
+        if (replaced != rowOverlay.end()) {
+            return replaced->second;
+        }
+        auto patch = rowPatches.find(id);
+        vector<pair<int, double>> row;
+        long long base = baseRow(id);
+        if (base >= 0) {
+            for (unsigned long long e = adjOffsets[base]; e < adjOffsets[base + 1]; ++e) {
+                int neighbor = books[adjTargets[e]].id;
+                if (patch == rowPatches.end() || !patch->second.count(neighbor)) {
+                    row.emplace_back(neighbor, adjWeights[e]);
+                }
+            }
+        }
+        if (patch != rowPatches.end()) {
+            for (const auto& edge : patch->second) {
+                if (edge.second != REMOVED_EDGE) {
+                    row.push_back(edge);
+                }
+            }
+            sort(row.begin(), row.end());
+        }
+        return row;
+    }
+
+    // Sets the weight of the edge from `id` to `neighbor` in the overlay, or removes it
+    void patchRow(int id, int neighbor, double weight) {
+        auto replaced = rowOverlay.find(id);
+        if (replaced == rowOverlay.end()) {
+            rowPatches[id][neighbor] = weight;
+            return;
+        }
+        vector<pair<int, double>>& row = replaced->second;
+        auto position = lower_bound(row.begin(), row.end(), make_pair(neighbor, -numeric_limits<double>::infinity()));
+        if (position != row.end() && position->first == neighbor) {
+            row.erase(position);
+        }
+        if (weight != REMOVED_EDGE) {
+            row.insert(lower_bound(row.begin(), row.end(), make_pair(neighbor, weight)), make_pair(neighbor, weight));
+        }
+    }
+
+    vector<int> liveIds() const {
+        vector<int> ids;
+        if (header) {
+            for (unsigned long long row = 0; row < header->books; ++row) {
+                if (!removedBooks.count(books[row].id)) {
+                    ids.push_back(books[row].id);
+                }
+            }
+        }
+        for (const auto& changed : changedBooks) {
+            if (baseRow(changed.first) < 0) {
+                ids.push_back(changed.first);
+            }
+        }
+        sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    static bool sameBook(const Libro& a, const Libro& b) {
+        return a.title == b.title && a.author == b.author && a.genre == b.genre &&
+               a.average_rating == b.average_rating && a.num_page == b.num_page &&
+               a.publication_date == b.publication_date && a.publisher == b.publisher;
+    }
+
+    // Bytes of each section for the counts in the header, or false if they cannot fit the file
+    bool sectionSizes(unsigned long long sizes[8]) const {
+        unsigned long long limit = mappedLength;
+        if (header->books > limit || header->books > numeric_limits<unsigned int>::max() ||
+            header->genres > limit || header->entries > limit || header->stringBytes > limit) {
+            return false;
+        }
+        sizes[BOOKS] = header->books * sizeof(ImageBook);
+        sizes[TITLES] = header->books * sizeof(unsigned int);
+        sizes[GENRES] = header->genres * sizeof(ImageGenre);
+        sizes[GENRE_ROWS] = header->books * sizeof(unsigned int);
+        sizes[ADJ_OFFSETS] = (header->books + 1) * sizeof(unsigned long long);
+        sizes[ADJ_TARGETS] = header->entries * sizeof(unsigned int);
+        sizes[ADJ_WEIGHTS] = header->entries * sizeof(double);
+        sizes[STRINGS] = header->stringBytes;
+        return true;
+    }
+
+    bool validText(unsigned long long offset, unsigned long long length) const {
+        return offset <= header->stringBytes && length <= header->stringBytes - offset;
+    }
+
+    /*
+     * Checks that every section lies inside the mapping, aligned, and that every row, string range
+     * and adjacency entry it holds points inside its section, so no lookup reads past the file.
+     */
+    bool validBase() const {
+        if (mappedLength < sizeof(ImageHeader) || memcmp(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0) {
+            return false;
+        }
+        unsigned long long sizes[8];
+        if (!sectionSizes(sizes)) {
+            return false;
+        }
+        for (int s = 0; s < 8; ++s) {
+            unsigned long long offset = header->section[s];
+            if (offset % 8 != 0 || offset < sizeof(ImageHeader) || offset > mappedLength ||
+                sizes[s] > mappedLength - offset) {
+                return false;
+            }
+        }
+
+        unsigned long long n = header->books;
+        const ImageBook* bookTable = reinterpret_cast<const ImageBook*>(mapped + header->section[BOOKS]);
+        for (unsigned long long row = 0; row < n; ++row) {
+            if (row > 0 && bookTable[row].id <= bookTable[row - 1].id) {
+                return false;   // baseRow() searches the ids
+            }
+            for (int f = 0; f < 5; ++f) {
+                if (!validText(bookTable[row].offset[f], bookTable[row].length[f])) {
+                    return false;
+                }
+            }
+        }
+        const unsigned int* rowSections[2] = {
+            reinterpret_cast<const unsigned int*>(mapped + header->section[TITLES]),
+            reinterpret_cast<const unsigned int*>(mapped + header->section[GENRE_ROWS])
+        };
+        for (const unsigned int* rows : rowSections) {
+            for (unsigned long long i = 0; i < n; ++i) {
+                if (rows[i] >= n) {
+                    return false;
+                }
+            }
+        }
+        const ImageGenre* genres = reinterpret_cast<const ImageGenre*>(mapped + header->section[GENRES]);
+        for (unsigned long long g = 0; g < header->genres; ++g) {
+            if (!validText(genres[g].name, genres[g].nameLength) || genres[g].first > n ||
+                genres[g].count > n - genres[g].first) {
+                return false;
+            }
+        }
+        const unsigned long long* offsets = reinterpret_cast<const unsigned long long*>(mapped + header->section[ADJ_OFFSETS]);
+        if (offsets[0] != 0 || offsets[n] != header->entries) {
+            return false;
+        }
+        for (unsigned long long row = 0; row < n; ++row) {
+            if (offsets[row] > offsets[row + 1]) {
+                return false;
+            }
+        }
+        const unsigned int* targets = reinterpret_cast<const unsigned int*>(mapped + header->section[ADJ_TARGETS]);
+        for (unsigned long long e = 0; e < header->entries; ++e) {
+            if (targets[e] >= n) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void mapBase() {
+        auto start = chrono::steady_clock::now();
+#if defined(__linux__)
+        string path = basePath();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;   // No base yet
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw runtime_error("No se pudo consultar la imagen " + path);
+        }
+        mappedLength = (size_t)info.st_size;
+        void* p = mappedLength > 0 ? mmap(nullptr, mappedLength, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (p == MAP_FAILED) {
+            throw runtime_error("No se pudo mapear la imagen " + path);
+        }
+        mapped = static_cast<const unsigned char*>(p);
+#else
+        throw runtime_error("CatalogImage requiere mmap");
+#endif
+        header = reinterpret_cast<const ImageHeader*>(mapped);
+        if (!validBase()) {
+            unmapBase();
+            throw runtime_error("Formato de imagen invalido: " + basePath());
+        }
+        books = reinterpret_cast<const ImageBook*>(mapped + header->section[BOOKS]);
+        titleRows = reinterpret_cast<const unsigned int*>(mapped + header->section[TITLES]);
+        genreTable = reinterpret_cast<const ImageGenre*>(mapped + header->section[GENRES]);
+        genreRows = reinterpret_cast<const unsigned int*>(mapped + header->section[GENRE_ROWS]);
+        adjOffsets = reinterpret_cast<const unsigned long long*>(mapped + header->section[ADJ_OFFSETS]);
+        adjTargets = reinterpret_cast<const unsigned int*>(mapped + header->section[ADJ_TARGETS]);
+        adjWeights = reinterpret_cast<const double*>(mapped + header->section[ADJ_WEIGHTS]);
+        strings = reinterpret_cast<const char*>(mapped + header->section[STRINGS]);
+        count = (size_t)header->books;
+        mapSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    void unmapBase() {
+#if defined(__linux__)
+        if (mapped) {
+            munmap(const_cast<unsigned char*>(mapped), mappedLength);
+        }
+#endif
+        mapped = nullptr;
+        mappedLength = 0;
+        header = nullptr;
+        changedBooks.clear();
+        removedBooks.clear();
+        titleOverlay.clear();
+        genreOverlay.clear();
+        rowOverlay.clear();
+        rowPatches.clear();
+        count = 0;
+        nextSequence = 1;
+        deltaBytes = 0;
+        overlaySeconds = 0;
+    }
+
+    /*
+     * Writes a base with `libros` in ascending id order; `rows` holds the neighbors of each book
+     * as rows of `libros`, ascending.
+     */
+    void writeBase(const vector<Libro>& libros, const vector<vector<pair<int, double>>>& rows) {
+        ImageHeader image;
+        memset(&image, 0, sizeof(image));
+        memcpy(image.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+        // A new identifier every time, so deltas of an earlier base are never applied to this one
+        image.base = max(wal_detail::nowMicros(), header ? header->base + 1 : 1);
+        image.books = libros.size();
+
+        string blob;
+        vector<ImageBook> records(libros.size());
+        for (size_t i = 0; i < libros.size(); ++i) {
+            const Libro& libro = libros[i];
+            ImageBook& record = records[i];
+            memset(&record, 0, sizeof(record));
+            record.id = libro.id;
+            record.pages = libro.num_page;
+            record.rating = libro.average_rating;
+            const string* fields[5] = {&libro.title, &libro.author, &libro.genre, &libro.publication_date, &libro.publisher};
+            for (int f = 0; f < 5; ++f) {
+                record.offset[f] = (unsigned int)blob.size();
+                record.length[f] = (unsigned int)fields[f]->size();
+                blob.append(*fields[f]);
+            }
+        }
+        image.stringBytes = blob.size();
+
+        // Rows are in id order already, so a stable sort by title leaves equal titles by id
+        vector<unsigned int> titles(libros.size());
+        iota(titles.begin(), titles.end(), 0u);
+        stable_sort(titles.begin(), titles.end(), [&](unsigned int a, unsigned int b) { return libros[a].title < libros[b].title; });
+
+        vector<unsigned int> byGenre(titles.size());
+        iota(byGenre.begin(), byGenre.end(), 0u);
+        stable_sort(byGenre.begin(), byGenre.end(), [&](unsigned int a, unsigned int b) { return libros[a].genre < libros[b].genre; });
+        vector<ImageGenre> genres;
+        for (unsigned int i = 0; i < byGenre.size(); ++i) {
+            if (i == 0 || libros[byGenre[i]].genre != libros[byGenre[i - 1]].genre) {
+                const ImageBook& first = records[byGenre[i]];
+                genres.push_back({first.offset[GENRE], first.length[GENRE], i, 0});
+            }
+            ++genres.back().count;
+        }
+        image.genres = genres.size();
+
+        vector<unsigned long long> offsets(libros.size() + 1, 0);
+        for (size_t i = 0; i < rows.size(); ++i) {
+            offsets[i + 1] = offsets[i] + rows[i].size();
+        }
+        image.entries = offsets.back();
+
+        auto aligned = [](unsigned long long position) { return (position + 7) / 8 * 8; };
+        unsigned long long sizes[8] = {
+            records.size() * sizeof(ImageBook), titles.size() * sizeof(unsigned int),
+            genres.size() * sizeof(ImageGenre), byGenre.size() * sizeof(unsigned int),
+            offsets.size() * sizeof(unsigned long long), image.entries * sizeof(unsigned int),
+            image.entries * sizeof(double), blob.size()
+        };
+        unsigned long long position = sizeof(ImageHeader);
+        for (int s = 0; s < 8; ++s) {
+            image.section[s] = position = aligned(position);
+            position += sizes[s];
+        }
+
+        string temporary = basePath() + ".tmp";
+        {
+            ofstream out(temporary, ios::binary | ios::trunc);
+            out.write(reinterpret_cast<const char*>(&image), sizeof(image));
+            unsigned long long written = sizeof(image);
+            // Pads up to where section `s` starts
+            auto startSection = [&](int s) {
+                static const char zeros[8] = {0};
+                out.write(zeros, (streamsize)(image.section[s] - written));
+                written = image.section[s] + sizes[s];
+            };
+            auto section = [&](int s, const void* data) {
+                startSection(s);
+                out.write(static_cast<const char*>(data), (streamsize)sizes[s]);
+            };
+            section(BOOKS, records.data());
+            section(TITLES, titles.data());
+            section(GENRES, genres.data());
+            section(GENRE_ROWS, byGenre.data());
+            section(ADJ_OFFSETS, offsets.data());
+            // Targets and weights are written row by row, without building the arrays
+            startSection(ADJ_TARGETS);
+            for (const auto& row : rows) {
+                for (const auto& neighbor : row) {
+                    unsigned int target = (unsigned int)neighbor.first;
+                    out.write(reinterpret_cast<const char*>(&target), sizeof(target));
+                }
+            }
+            startSection(ADJ_WEIGHTS);
+            for (const auto& row : rows) {
+                for (const auto& neighbor : row) {
+                    out.write(reinterpret_cast<const char*>(&neighbor.second), sizeof(neighbor.second));
+                }
+            }
+            section(STRINGS, blob.data());
+            if (!out) {
+                throw runtime_error("No se pudo escribir la imagen " + temporary);
+            }
+        }
+        publish(temporary, basePath());
+    }
+
+    static string encodeDelta(const Delta& delta) {
+        using wal_detail::put;
+        using wal_detail::putString;
+        string payload;
+        put(payload, (unsigned int)delta.books.size());
+        for (const Libro& libro : delta.books) {
+            put(payload, libro.id);
+            putString(payload, libro.title);
+            putString(payload, libro.author);
+            putString(payload, libro.genre);
+            put(payload, libro.average_rating);
+            put(payload, libro.num_page);
+            putString(payload, libro.publication_date);
+            putString(payload, libro.publisher);
+        }
+        put(payload, (unsigned int)delta.removed.size());
+        for (int id : delta.removed) {
+            put(payload, id);
+        }
+        for (const auto* entries : {&delta.titles, &delta.genres}) {
+            put(payload, (unsigned int)entries->size());
+            for (const auto& entry : *entries) {
+                putString(payload, entry.first);
+                put(payload, entry.second.first);
+                put(payload, (unsigned char)entry.second.second);
+            }
+        }
+        put(payload, (unsigned int)delta.rows.size());
+        for (const auto& row : delta.rows) {
+            put(payload, row.first);
+            put(payload, (unsigned int)row.second.size());
+            for (const auto& neighbor : row.second) {
+                put(payload, neighbor.first);
+                put(payload, neighbor.second);
+            }
+        }
+        return payload;
+    }
+
+    static bool decodeDelta(const string& payload, Delta& delta) {
+        wal_detail::Cursor in{payload.data(), payload.size()};
+        unsigned int size;
+        if (!in.get(size)) {
+            return false;
+        }
+        delta.books.resize(size);
+        for (Libro& libro : delta.books) {
+            if (!(in.get(libro.id) && in.getString(libro.title) && in.getString(libro.author) &&
+                  in.getString(libro.genre) && in.get(libro.average_rating) && in.get(libro.num_page) &&
+                  in.getString(libro.publication_date) && in.getString(libro.publisher))) {
+                return false;
+            }
+        }
+        if (!in.get(size)) {
+            return false;
+        }
+        delta.removed.resize(size);
+        for (int& id : delta.removed) {
+            if (!in.get(id)) {
+                return false;
+            }
+        }
+        for (auto* entries : {&delta.titles, &delta.genres}) {
+            if (!in.get(size)) {
+                return false;
+            }
+            entries->resize(size);
+            for (auto& entry : *entries) {
+                unsigned char present;
+                if (!in.getString(entry.first) || !in.get(entry.second.first) || !in.get(present)) {
+                    return false;
+                }
+                entry.second.second = present != 0;
+            }
+        }
+        if (!in.get(size)) {
+            return false;
+        }
+        delta.rows.resize(size);
+        for (auto& row : delta.rows) {
+            unsigned int neighbors;
+            if (!in.get(row.first) || !in.get(neighbors)) {
+                return false;
+            }
+            row.second.resize(neighbors);
+            for (auto& neighbor : row.second) {
+                if (!in.get(neighbor.first) || !in.get(neighbor.second)) {
+                    return false;
+                }
+            }
+        }
+        return in.pos == payload.size();
+    }
+
+    void overlayEntries(unordered_map<string, set<int>>& overlay, const vector<pair<string, pair<int, bool>>>& entries,
+                        bool titles) {
+        for (const auto& entry : entries) {
+            auto it = overlay.find(entry.first);
+            if (it == overlay.end()) {
+                vector<int> ids = titles ? baseTitleIds(entry.first) : baseGenreIds(entry.first);
+                it = overlay.emplace(entry.first, set<int>(ids.begin(), ids.end())).first;
+            }
+            if (entry.second.second) {
+                it->second.insert(entry.second.first);
+            } else {
+                it->second.erase(entry.second.first);
+            }
+        }
+    }
+
+    void applyDelta(const Delta& delta) {
+        // Rows as they were before this delta: every edge to a changed or removed book goes away,
+        // then the new rows add back the ones that remain
+        unordered_set<int> replaced(delta.removed.begin(), delta.removed.end());
+        for (const auto& row : delta.rows) {
+            replaced.insert(row.first);
+        }
+        for (int id : replaced) {
+            Libro previous;
+            if (!lookup(id, previous)) {
+                continue;
+            }
+            for (const auto& neighbor : rowOf(id)) {
+                if (!replaced.count(neighbor.first)) {
+                    patchRow(neighbor.first, id, REMOVED_EDGE);
+                }
+            }
+        }
+        for (const auto& row : delta.rows) {
+            for (const auto& neighbor : row.second) {
+                if (!replaced.count(neighbor.first)) {
+                    patchRow(neighbor.first, row.first, neighbor.second);
+                }
+            }
+        }
+
+        for (const Libro& libro : delta.books) {
+            Libro previous;
+            if (!lookup(libro.id, previous)) {
+                ++count;
+            }
+            changedBooks[libro.id] = libro;
+            removedBooks.erase(libro.id);
+        }
+        for (int id : delta.removed) {
+            Libro previous;
+            if (lookup(id, previous)) {
+                --count;
+            }
+            changedBooks.erase(id);
+            rowOverlay.erase(id);
+            rowPatches.erase(id);
+            if (baseRow(id) >= 0) {
+                removedBooks.insert(id);
+            }
+        }
+        overlayEntries(titleOverlay, delta.titles, true);
+        overlayEntries(genreOverlay, delta.genres, false);
+        for (const auto& row : delta.rows) {
+            rowOverlay[row.first] = row.second;
+            rowPatches.erase(row.first);
+        }
+    }
+
+    void loadDeltas() {
+        auto start = chrono::steady_clock::now();
+        for (unsigned long long sequence = 1;; ++sequence) {
+            string path = deltaPath(sequence);
+            ifstream in(path, ios::binary);
+            if (!in) {
+                break;
+            }
+            char magic[8];
+            unsigned long long base = 0, number = 0;
+            unsigned int length = 0, crc = 0;
+            in.read(magic, sizeof(magic));
+            in.read(reinterpret_cast<char*>(&base), sizeof(base));
+            in.read(reinterpret_cast<char*>(&number), sizeof(number));
+            in.read(reinterpret_cast<char*>(&length), sizeof(length));
+            in.read(reinterpret_cast<char*>(&crc), sizeof(crc));
+            if (!in || memcmp(magic, DELTA_MAGIC, sizeof(magic)) != 0) {
+                throw runtime_error("Formato de delta invalido: " + path);
+            }
+            if (base != header->base) {
+                // Left over from before the last compaction: the base already holds it
+                in.close();
+                removeDeltas(sequence);
+                break;
+            }
+            // The claimed length must fit in the file before anything is allocated for it
+            unsigned long long position = (unsigned long long)in.tellg();
+            if (length > wal_detail::fileSize(in, position) - position) {
+                throw runtime_error("Delta corrupto: " + path);
+            }
+            string payload(length, '\0');
+            Delta delta;
+            if (number != sequence || !in.read(&payload[0], length) || crc32(payload.data(), length) != crc ||
+                !decodeDelta(payload, delta)) {
+                throw runtime_error("Delta corrupto: " + path);
+            }
+            applyDelta(delta);
+            deltaBytes += sizeof(magic) + sizeof(base) + sizeof(number) + sizeof(length) + sizeof(crc) + length;
+            nextSequence = sequence + 1;
+        }
+        overlaySeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Deletes the deltas numbered from `first` on
+    void removeDeltas(unsigned long long first) {
+        for (unsigned long long sequence = first; filesystem::exists(deltaPath(sequence)); ++sequence) {
+            filesystem::remove(deltaPath(sequence));
+        }
+    }
+
+    void writeDelta(const Delta& delta) {
+        string payload = encodeDelta(delta);
+        string path = deltaPath(nextSequence);
+        string temporary = path + ".tmp";
+        {
+            ofstream out(temporary, ios::binary | ios::trunc);
+            unsigned int length = (unsigned int)payload.size();
+            unsigned int crc = crc32(payload.data(), payload.size());
+            out.write(DELTA_MAGIC, sizeof(DELTA_MAGIC));
+            out.write(reinterpret_cast<const char*>(&header->base), sizeof(header->base));
+            out.write(reinterpret_cast<const char*>(&nextSequence), sizeof(nextSequence));
+            out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            out.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
+            out.write(payload.data(), (streamsize)payload.size());
+            if (!out) {
+                throw runtime_error("No se pudo escribir el delta " + temporary);
+            }
+        }
+        publish(temporary, path);
+        deltaBytes += sizeof(DELTA_MAGIC) + 2 * sizeof(unsigned long long) + 2 * sizeof(unsigned int) + payload.size();
+        ++nextSequence;
+    }
+
+public:
+    struct CommitStats {
+        unsigned long long sequence = 0;   // 0 if nothing changed or a new base was written
+        size_t books = 0;
+        size_t removed = 0;
+        size_t indexEntries = 0;
+        size_t rows = 0;
+        size_t bytes = 0;
+        bool compacted = false;
+    };
+
+    CatalogImage(const string& directory, size_t maxDeltas = 8, double compactRatio = 0.25)
+        : directory(directory), maxDeltas(maxDeltas), compactRatio(compactRatio) {
+        filesystem::create_directories(directory);
+        mapBase();
+        if (header) {
+            loadDeltas();
+        }
+    }
+
+    ~CatalogImage() {
+        unmapBase();
+    }
+
+    CatalogImage(const CatalogImage&) = delete;
+    CatalogImage& operator=(const CatalogImage&) = delete;
+
+    bool hasBase() const {
+        return header != nullptr;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Books with the same title resolve to the one with the lowest id
+    bool findTitle(const string& title, Libro& libro) const {
+        auto overlay = titleOverlay.find(title);
+        if (overlay != titleOverlay.end()) {
+            return !overlay->second.empty() && lookup(*overlay->second.begin(), libro);
+        }
+        vector<int> ids = baseTitleIds(title);
+        return !ids.empty() && lookup(ids.front(), libro);
+    }
+
+    vector<Libro> booksInGenre(const string& genre) const {
+        auto overlay = genreOverlay.find(genre);
+        vector<int> ids = overlay != genreOverlay.end() ? vector<int>(overlay->second.begin(), overlay->second.end())
+                                                        : baseGenreIds(genre);
+        vector<Libro> result(ids.size());
+        for (size_t i = 0; i < ids.size(); ++i) {
+            lookup(ids[i], result[i]);
+        }
+        return result;
+    }
+
+    // Neighbors of the book with that title, in id order
+    vector<pair<Libro, double>> similar(const string& title) const {
+        vector<pair<Libro, double>> result;
+        Libro libro;
+        if (findTitle(title, libro)) {
+            for (const auto& neighbor : rowOf(libro.id)) {
+                result.emplace_back(Libro(), neighbor.second);
+                lookup(neighbor.first, result.back().first);
+            }
+        }
+        return result;
+    }
+
+    /*
+     * Makes the image hold `libros`: writes the base if there is none, otherwise a delta with
+     * what differs from the current view, and compacts when the chain has grown too much.
+     */
+    template <typename Container>
+    CommitStats commit(const Container& libros) {
+        vector<Libro> sorted;
+        sorted.reserve(libros.size());
+        for (size_t i = 0; i < libros.size(); ++i) {
+            sorted.push_back(libros[i]);
+        }
+        stable_sort(sorted.begin(), sorted.end(), [](const Libro& a, const Libro& b) { return a.id < b.id; });
+        // As when they are loaded into the store one by one, the last book with an id wins
+        vector<Libro> catalog;
+        catalog.reserve(sorted.size());
+        for (Libro& libro : sorted) {
+            if (!catalog.empty() && catalog.back().id == libro.id) {
+                catalog.back() = move(libro);
+            } else {
+                catalog.push_back(move(libro));
+            }
+        }
+
+        BucketSimilarityGraph graph;
+        graph.build(catalog);
+        CommitStats stats;
+
+        if (!header) {
+            vector<vector<pair<int, double>>> rows(catalog.size());
+            for (size_t i = 0; i < catalog.size(); ++i) {
+                rows[i] = graph.neighbors((int)i);
+            }
+            writeBase(catalog, rows);
+            mapBase();
+            stats.books = catalog.size();
+            stats.bytes = mappedLength;
+            return stats;
+        }
+
+        Delta delta;
+        unordered_map<int, int> position;
+        for (size_t i = 0; i < catalog.size(); ++i) {
+            position[catalog[i].id] = (int)i;
+        }
+        for (size_t i = 0; i < catalog.size(); ++i) {
+            const Libro& libro = catalog[i];
+            Libro previous;
+            bool existed = lookup(libro.id, previous);
+            if (existed && sameBook(previous, libro)) {
+                continue;
+            }
+            delta.books.push_back(libro);
+            if (!existed || previous.title != libro.title) {
+                if (existed) {
+                    delta.titles.push_back({previous.title, {libro.id, false}});
+                }
+                delta.titles.push_back({libro.title, {libro.id, true}});
+            }
+            if (!existed || previous.genre != libro.genre) {
+                if (existed) {
+                    delta.genres.push_back({previous.genre, {libro.id, false}});
+                }
+                delta.genres.push_back({libro.genre, {libro.id, true}});
+            }
+            vector<pair<int, double>> row;
+            for (const auto& neighbor : graph.neighbors((int)i)) {
+                row.emplace_back(catalog[neighbor.first].id, neighbor.second);
+            }
+            delta.rows.emplace_back(libro.id, row);
+        }
+        for (int id : liveIds()) {
+            if (position.count(id)) {
+                continue;
+            }
+            Libro previous;
+            lookup(id, previous);
+            delta.removed.push_back(id);
+            delta.titles.push_back({previous.title, {id, false}});
+            delta.genres.push_back({previous.genre, {id, false}});
+        }
+        if (delta.books.empty() && delta.removed.empty()) {
+            return stats;
+        }
+
+        stats.sequence = nextSequence;
+        stats.books = delta.books.size();
+        stats.removed = delta.removed.size();
+        stats.indexEntries = delta.titles.size() + delta.genres.size();
+        stats.rows = delta.rows.size();
+        size_t before = deltaBytes;
+        writeDelta(delta);
+        applyDelta(delta);
+        stats.bytes = deltaBytes - before;
+
+        if (nextSequence - 1 > maxDeltas || (double)deltaBytes > compactRatio * (double)mappedLength) {
+            compact();
+            stats.compacted = true;
+        }
+        return stats;
+    }
+
+    // Folds the deltas into a new base; the adjacency rows are copied, not recomputed
+    void compact() {
+        if (!header || nextSequence == 1) {
+            return;
+        }
+        vector<int> ids = liveIds();
+        vector<Libro> catalog(ids.size());
+        vector<vector<pair<int, double>>> rows(ids.size());
+        for (size_t i = 0; i < ids.size(); ++i) {
+            lookup(ids[i], catalog[i]);
+            for (const auto& neighbor : rowOf(ids[i])) {
+                int row = (int)(lower_bound(ids.begin(), ids.end(), neighbor.first) - ids.begin());
+                rows[i].emplace_back(row, neighbor.second);
+            }
+        }
+        unsigned long long lastDelta = nextSequence - 1;
+        writeBase(catalog, rows);
+        unmapBase();
+        mapBase();
+        // The new base is in place, so a crash here only leaves deltas that the next open discards
+        for (unsigned long long sequence = 1; sequence <= lastDelta; ++sequence) {
+            filesystem::remove(deltaPath(sequence));
+        }
+    }
+
+    void printMetrics(ostream& out) const {
+        ios::fmtflags flags = out.flags();
+        streamsize precision = out.precision();
+        out << fixed << setprecision(1) << "Imagen del catalogo: " << count << " libros; base de "
+            << (header ? header->books : 0) << " libros y " << (header ? header->entries / 2 : 0) << " aristas ("
+            << mappedLength / 1024.0 << " KB, mapeada en " << mapSeconds * 1e6 << " us), " << nextSequence - 1
+            << " deltas (" << deltaBytes / 1024.0 << " KB, superpuestos en " << overlaySeconds * 1e6 << " us)\n"
+            << "  superposicion: " << changedBooks.size() << " libros cambiados, " << removedBooks.size()
+            << " eliminados, " << titleOverlay.size() << " titulos y " << genreOverlay.size() << " generos, "
+            << rowOverlay.size() << " filas de adyacencia reemplazadas y " << rowPatches.size() << " parcheadas\n";
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+#endif
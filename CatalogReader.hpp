@@ -0,0 +1,178 @@
+#ifndef CATALOG_READER_HPP
+#define CATALOG_READER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cctype>
+#include <iomanip>
+#include <limits>
+#include <iterator>
+#include "WeightedUndirectedGraph.hpp"
+
+using namespace std;
+
+inline string cleanString(const string& str) { //Se tuvo que recurrir a esta funcion para limpiar los caracteres ya que al parecer algunos tenian caracteres invisibles
+    string cleaned;
+    for (char c : str) {
+        if (isdigit((unsigned char)c)) {
+            cleaned += c;  // Solo agrega caracteres numéricos
+        }
+    }
+    return cleaned;
+}
+
+// Parses one CSV line: id,title,author,genre,average_rating,num_page,publication_date,publisher
+inline Libro parseLibro(const string& line) {
+    stringstream ss(line);
+    string temp;
+    Libro libro;
+
+    getline(ss, temp, ',');
+    temp = cleanString(temp);  // Limpia el ID de caracteres invisibles
+    libro.id = stoi(temp);
+
+    getline(ss, libro.title, ',');
+
+    getline(ss, libro.author, ',');
+
+    getline(ss, libro.genre, ',');
+
+    getline(ss, temp, ',');
+    libro.average_rating = stof(temp);
+
+    getline(ss, temp, ',');
+    libro.num_page = stoi(temp);
+
+    getline(ss, libro.publication_date, ',');
+
+    getline(ss, libro.publisher, ',');
+
+    return libro;
+}
+
+// Writes a book as a CSV line that parseLibro reads back unchanged
+inline string formatLibro(const Libro& libro) {
+    ostringstream rating;
+    rating << libro.average_rating;
+    if (stof(rating.str()) != libro.average_rating) {
+        rating.str("");
+        rating << setprecision(numeric_limits<float>::max_digits10) << libro.average_rating;
+    }
+
+    ostringstream line;
+    line << libro.id << ',' << libro.title << ',' << libro.author << ',' << libro.genre << ','
+         << rating.str() << ',' << libro.num_page << ',' << libro.publication_date << ',' << libro.publisher;
+    return line.str();
+}
+
+// Position and checksum of one line of the CSV, used to find the rows that changed
+struct CatalogRow {
+    unsigned long long offset;
+    unsigned long long checksum;
+    int book;       // Index of the book parsed from the line, -1 if the line is not a valid book
+};
+
+// FNV-1a of a line
+inline unsigned long long rowChecksum(const char* line, size_t length) {
+    unsigned long long hash = 1469598103934665603ull;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (unsigned char)line[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+inline unsigned long long rowChecksum(const string& line) {
+    return rowChecksum(line.data(), line.size());
+}
+
+/*
+ * Reads the complete lines of the file that start at or after `offset`, with their offsets. A
+ * last line without a newline is still being written and is left for the next read. Returns
+ * the offset just past the last complete line, or -1 if the file cannot be read from there.
+ */
+inline long long readCompleteLines(const string& path, unsigned long long offset,
+                                   vector<pair<unsigned long long, string>>& lines) {
+    lines.clear();
+    ifstream file(path, ios::binary);
+    if (!file || !file.seekg((streamoff)offset)) {
+        return -1;
+    }
+    string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    size_t start = 0;
+    size_t newline;
+    while ((newline = contents.find('\n', start)) != string::npos) {
+        string line = contents.substr(start, newline - start);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        lines.emplace_back(offset + start, std::move(line));
+        start = newline + 1;
+    }
+    return (long long)(offset + start);
+}
+
+// A parsed book together with the byte offset of its line in the CSV
+struct CatalogRecord {
+    unsigned long long offset;
+    Libro libro;
+};
+
+/*
+ * Reads the catalog CSV in fixed-size batches so that it never has to be held in memory, and
+ * fetches single books back by the byte offset of their line.
+ */
+class CatalogReader {
+    string path;
+    ifstream file;
+    ifstream randomAccess;
+    unsigned long long offset = 0;
+    unsigned long long rows = 0;
+
+public:
+    explicit CatalogReader(const string& path) : path(path), file(path, ios::binary), randomAccess(path, ios::binary) {}
+
+    bool good() const {
+        return file.is_open();
+    }
+
+    unsigned long long rowsRead() const {
+        return rows;
+    }
+
+    // Fills the batch with up to maxRecords books, returns false when the file is exhausted
+    bool nextBatch(vector<CatalogRecord>& batch, size_t maxRecords) {
+        batch.clear();
+        string line;
+        while (batch.size() < maxRecords && getline(file, line)) {
+            unsigned long long lineOffset = offset;
+            offset += line.size() + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+            batch.push_back({lineOffset, parseLibro(line)});
+            ++rows;
+        }
+        return !batch.empty();
+    }
+
+    // Reads the book whose line starts at the given offset
+    Libro readAt(unsigned long long lineOffset) {
+        randomAccess.clear();
+        randomAccess.seekg((streamoff)lineOffset);
+        string line;
+        getline(randomAccess, line);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        return parseLibro(line);
+    }
+};
+
+#endif
@@ -0,0 +1,692 @@
+#ifndef CATALOG_WAL_HPP
+#define CATALOG_WAL_HPP
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <stdexcept>
+#include <filesystem>
+#include "KeyValueAVLTree.hpp"
+#include "SegmentedDynamicArray_SR.hpp"
+#include "CatalogReader.hpp"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/*
+ * Write-ahead log of catalog mutations:
+ *
+ *   char[8]        magic "SRWAL01"
+ *   records:       uint32 payload length, uint32 CRC-32 of the payload, payload
+ *   payload:       uint64 lsn, uint8 type, int32 id, then for additions and updates
+ *                  title, author, genre (uint32 length + bytes), float rating, int32 pages,
+ *                  publication date, publisher; then uint64 append time in microseconds since
+ *                  the epoch (absent in older records)
+ *
+ * Replay stops at the first short or corrupt record, which is what a crash in the middle of a
+ * write leaves behind, and truncates the file there. A truncated log starts with a checkpoint
+ * record: the snapshot holds every mutation before its LSN, and LSNs keep growing across
+ * checkpoints and restarts so that followers can tell where they are.
+ */
+const char WAL_MAGIC[8] = "SRWAL01";
+
+enum class MutationType : unsigned char {
+    Add = 1,
+    Update = 2,
+    Remove = 3,
+    Checkpoint = 4
+};
+
+struct Mutation {
+    MutationType type;
+    Libro libro;    // Only the id is used by Remove, nothing by Checkpoint
+};
+
+inline unsigned int crc32(const char* data, size_t length) {
+    static unsigned int table[256];
+    static once_flag built;
+    call_once(built, []() {
+        for (unsigned int i = 0; i < 256; ++i) {
+            unsigned int c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    });
+    unsigned int crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+namespace wal_detail {
+
+template <typename T>
+void put(string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+inline void putString(string& out, const string& value) {
+    put(out, (unsigned int)value.size());
+    out.append(value);
+}
+
+// Reads from a payload, failing instead of reading past its end
+struct Cursor {
+    const char* data;
+    size_t length;
+    size_t pos = 0;
+
+    template <typename T>
+    bool get(T& value) {
+        if (length - pos < sizeof(T)) {
+            return false;
+        }
+        memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    bool getString(string& value) {
+        unsigned int size;
+        if (!get(size) || length - pos < size) {
+            return false;
+        }
+        value.assign(data + pos, size);
+        pos += size;
+        return true;
+    }
+};
+
+inline unsigned long long nowMicros() {
+    return (unsigned long long)chrono::duration_cast<chrono::microseconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline string encode(unsigned long long lsn, const Mutation& mutation) {
+    string payload;
+    put(payload, lsn);
+    put(payload, (unsigned char)mutation.type);
+    put(payload, mutation.libro.id);
+    if (mutation.type == MutationType::Add || mutation.type == MutationType::Update) {
+        putString(payload, mutation.libro.title);
+        putString(payload, mutation.libro.author);
+        putString(payload, mutation.libro.genre);
+        put(payload, mutation.libro.average_rating);
+        put(payload, mutation.libro.num_page);
+        putString(payload, mutation.libro.publication_date);
+        putString(payload, mutation.libro.publisher);
+    }
+    put(payload, nowMicros());
+
+    string record;
+    put(record, (unsigned int)payload.size());
+    put(record, crc32(payload.data(), payload.size()));
+    record.append(payload);
+    return record;
+}
+
+// `appendedAt` is left at 0 for records written before the append time was stored
+inline bool decode(const string& payload, unsigned long long& lsn, Mutation& mutation,
+                   unsigned long long* appendedAt = nullptr) {
+    Cursor in{payload.data(), payload.size()};
+    unsigned char type;
+    if (!in.get(lsn) || !in.get(type) || !in.get(mutation.libro.id)) {
+        return false;
+    }
+    mutation.type = (MutationType)type;
+    if (mutation.type == MutationType::Add || mutation.type == MutationType::Update) {
+        if (!(in.getString(mutation.libro.title) && in.getString(mutation.libro.author)
+              && in.getString(mutation.libro.genre) && in.get(mutation.libro.average_rating)
+              && in.get(mutation.libro.num_page) && in.getString(mutation.libro.publication_date)
+              && in.getString(mutation.libro.publisher))) {
+            return false;
+        }
+    } else if (mutation.type != MutationType::Remove && mutation.type != MutationType::Checkpoint) {
+        return false;
+    }
+    unsigned long long time = 0;
+    in.get(time);
+    if (appendedAt) {
+        *appendedAt = time;
+    }
+    return true;
+}
+
+/*
+ * Reads the length, CRC and payload of the record at the position of `in`. `available` is the
+ * number of bytes of the file from that position on; a length beyond it, or beyond any book a
+ * record could hold, is a torn or corrupt header and is rejected before allocating. Sets
+ * `framed` to the size of the whole record.
+ */
+const unsigned int MAX_RECORD_BYTES = 16 * 1024 * 1024;
+
+inline bool readRecord(istream& in, unsigned long long available, string& payload, unsigned long long& framed) {
+    unsigned int length, crc;
+    if (!in.read(reinterpret_cast<char*>(&length), sizeof(length)) ||
+        !in.read(reinterpret_cast<char*>(&crc), sizeof(crc))) {
+        return false;
+    }
+    framed = sizeof(length) + sizeof(crc) + (unsigned long long)length;
+    if (length > MAX_RECORD_BYTES || framed > available) {
+        return false;
+    }
+    payload.resize(length);
+    return in.read(&payload[0], length) && crc32(payload.data(), length) == crc;
+}
+
+// Size of the file open in `in`, leaving it positioned at `position`
+inline unsigned long long fileSize(istream& in, unsigned long long position) {
+    in.seekg(0, ios::end);
+    streamoff size = in.tellg();
+    in.seekg((streamoff)position);
+    return size > 0 ? (unsigned long long)size : 0;
+}
+
+// Flushes a file and, when possible, its contents to the device
+inline void syncFile(int fd) {
+#if defined(__linux__)
+    if (fdatasync(fd) != 0) {
+        throw runtime_error("fdatasync fallo en el WAL");
+    }
+#else
+    (void)fd;
+#endif
+}
+
+} // namespace wal_detail
+
+/*
+ * Append-only log with group commit. append() only queues the encoded record; a flusher thread
+ * writes everything queued with one write and one fdatasync, so every writer that arrived
+ * while the previous sync was running shares the next one. commit() returns once the record
+ * is on disk.
+ */
+class WriteAheadLog {
+    string path;
+    int fd = -1;
+    mutex lock;
+    condition_variable work;
+    condition_variable durable;
+    string pending;
+    unsigned long long nextLsn = 1;
+    unsigned long long queuedLsn = 0;       // Last LSN in `pending` or already written
+    unsigned long long durableLsn = 0;
+    bool syncing = false;
+    bool stopping = false;
+    string failure;                         // Set if a write or sync failed; later commits throw
+    unsigned long long syncCount = 0;
+    unsigned long long recordCount = 0;
+    thread flusher;
+
+    void flushLoop() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            work.wait(guard, [&]() { return stopping || !pending.empty(); });
+            if (pending.empty()) {
+                return;
+            }
+            string batch;
+            batch.swap(pending);
+            unsigned long long batchLsn = queuedLsn;
+            syncing = true;
+            guard.unlock();
+
+            string error;
+            try {
+                writeAll(batch);
+                wal_detail::syncFile(fd);
+            } catch (const exception& e) {
+                error = e.what();
+            }
+
+            guard.lock();
+            syncing = false;
+            if (error.empty()) {
+                ++syncCount;
+                durableLsn = batchLsn;
+            } else if (failure.empty()) {
+                failure = error;
+            }
+            durable.notify_all();
+        }
+    }
+
+    void writeAll(const string& bytes) {
+#if defined(__linux__)
+        size_t written = 0;
+        while (written < bytes.size()) {
+            ssize_t n = ::write(fd, bytes.data() + written, bytes.size() - written);
+            if (n < 0) {
+                throw runtime_error("No se pudo escribir el WAL " + path);
+            }
+            written += (size_t)n;
+        }
+#else
+        ofstream out(path, ios::binary | ios::app);
+        out.write(bytes.data(), bytes.size());
+#endif
+    }
+
+public:
+    // Opens the log; replay() must be called before the first append if the file has records
+    explicit WriteAheadLog(const string& path) : path(path) {
+        {
+            ifstream existing(path, ios::binary);
+            char magic[8] = {};
+            if (!existing.read(magic, sizeof(magic)) || memcmp(magic, WAL_MAGIC, sizeof(magic)) != 0) {
+                existing.close();
+                ofstream created(path, ios::binary | ios::trunc);
+                created.write(WAL_MAGIC, sizeof(WAL_MAGIC));
+            }
+        }
+#if defined(__linux__)
+        fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+        if (fd < 0) {
+            throw runtime_error("No se pudo abrir el WAL " + path);
+        }
+#endif
+        flusher = thread(&WriteAheadLog::flushLoop, this);
+    }
+
+    ~WriteAheadLog() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        work.notify_all();
+        flusher.join();
+#if defined(__linux__)
+        ::close(fd);
+#endif
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    /*
+     * Calls apply for every valid record in order and cuts the torn tail, if any. Returns the
+     * number of records replayed.
+     */
+    unsigned long long replay(function<void(const Mutation&)> apply) {
+        ifstream in(path, ios::binary);
+        unsigned long long validEnd = sizeof(WAL_MAGIC);
+        unsigned long long size = wal_detail::fileSize(in, validEnd);
+        unsigned long long replayed = 0;
+        string payload;
+        while (validEnd < size) {
+            unsigned long long framed;
+            if (!wal_detail::readRecord(in, size - validEnd, payload, framed)) {
+                break;
+            }
+            unsigned long long lsn;
+            Mutation mutation;
+            if (!wal_detail::decode(payload, lsn, mutation)) {
+                break;
+            }
+            if (mutation.type != MutationType::Checkpoint) {
+                apply(mutation);
+                ++replayed;
+            }
+            validEnd += framed;
+            lock_guard<mutex> guard(lock);
+            nextLsn = lsn + 1;
+            queuedLsn = durableLsn = lsn;
+        }
+        in.close();
+
+#if defined(__linux__)
+        if (ftruncate(fd, (off_t)validEnd) != 0) {
+            throw runtime_error("No se pudo recortar el WAL " + path);
+        }
+#endif
+        return replayed;
+    }
+
+    // Queues a record and returns its LSN; it is durable once waitDurable(lsn) returns
+    unsigned long long append(const Mutation& mutation) {
+        lock_guard<mutex> guard(lock);
+        unsigned long long lsn = nextLsn++;
+        pending += wal_detail::encode(lsn, mutation);
+        queuedLsn = lsn;
+        ++recordCount;
+        work.notify_one();
+        return lsn;
+    }
+
+    void waitDurable(unsigned long long lsn) {
+        unique_lock<mutex> guard(lock);
+        durable.wait(guard, [&]() { return durableLsn >= lsn || !failure.empty(); });
+        if (durableLsn < lsn) {
+            throw runtime_error(failure);
+        }
+    }
+
+    unsigned long long commit(const Mutation& mutation) {
+        unsigned long long lsn = append(mutation);
+        waitDurable(lsn);
+        return lsn;
+    }
+
+    // Waits until every queued record is durable and returns the last LSN
+    unsigned long long flush() {
+        unsigned long long lsn;
+        {
+            lock_guard<mutex> guard(lock);
+            lsn = queuedLsn;
+        }
+        waitDurable(lsn);
+        return lsn;
+    }
+
+    /*
+     * Drops every record once the queued ones are written and leaves a checkpoint record; used
+     * after a checkpoint. The new log is written and synced beside the old one and renamed over
+     * it, so a crash leaves either the old records or the checkpoint, never a log without an LSN.
+     */
+    void truncate() {
+        unique_lock<mutex> guard(lock);
+        durable.wait(guard, [&]() { return pending.empty() && !syncing; });
+        unsigned long long lsn = nextLsn;
+        string temporary = path + ".tmp";
+        {
+            ofstream created(temporary, ios::binary | ios::trunc);
+            created.write(WAL_MAGIC, sizeof(WAL_MAGIC));
+            string marker = wal_detail::encode(lsn, {MutationType::Checkpoint, Libro()});
+            created.write(marker.data(), marker.size());
+            if (!created) {
+                throw runtime_error("No se pudo escribir el WAL " + temporary);
+            }
+        }
+#if defined(__linux__)
+        int replacement = ::open(temporary.c_str(), O_WRONLY | O_APPEND);
+        if (replacement < 0) {
+            throw runtime_error("No se pudo abrir el WAL " + temporary);
+        }
+        try {
+            wal_detail::syncFile(replacement);
+        } catch (...) {
+            ::close(replacement);
+            throw;
+        }
+        if (rename(temporary.c_str(), path.c_str()) != 0) {
+            ::close(replacement);
+            throw runtime_error("No se pudo reemplazar el WAL " + path);
+        }
+        ::close(fd);
+        fd = replacement;
+        string directory = path.substr(0, path.find_last_of('/') + 1);
+        int dirFd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+        if (dirFd >= 0) {
+            fsync(dirFd);
+            ::close(dirFd);
+        }
+#else
+        if (rename(temporary.c_str(), path.c_str()) != 0) {
+            throw runtime_error("No se pudo reemplazar el WAL " + path);
+        }
+#endif
+        nextLsn = lsn + 1;
+        queuedLsn = durableLsn = lsn;
+    }
+
+    // Number of fdatasync calls and of records appended since the log was opened
+    unsigned long long syncs() {
+        lock_guard<mutex> guard(lock);
+        return syncCount;
+    }
+
+    unsigned long long records() {
+        lock_guard<mutex> guard(lock);
+        return recordCount;
+    }
+};
+
+/*
+ * The catalog as a set of books keyed by id, made durable by a snapshot (a CSV in the same
+ * format as the original catalog) plus the write-ahead log of the mutations made after it.
+ *
+ * Mutations are validated and appended to the log under one lock and wait for their fsync outside
+ * it, so concurrent writers share syncs. Until then they stay in `inFlight`, where later
+ * mutations of the same id see them when checking whether it exists, but readers do not: they
+ * are applied to the books in LSN order only once durable, so the apply order is the log order
+ * and nothing that could still be lost is ever visible. Every
+ * `checkpointEvery` mutations a new snapshot is written to a temporary file, synced and renamed
+ * over the old one, and the log is truncated. A crash between the rename and the truncation
+ * replays mutations already in the snapshot, which is harmless because replay applies them as
+ * upserts and deletes by id.
+ */
+class CatalogStore {
+    string snapshotPath;
+    KeyValueAVLTree<int, Libro> books;
+    unsigned long long count = 0;
+    unique_ptr<WriteAheadLog> wal;
+    mutex lock;
+    map<unsigned long long, Mutation> inFlight;     // Appended but not yet applied, by LSN
+    unsigned long long checkpointEvery;
+    unsigned long long sinceCheckpoint = 0;
+    unsigned long long snapshotBooks = 0;
+    unsigned long long replayed = 0;
+    double recoverySeconds = 0;
+
+    void upsertLocked(const Libro& libro) {
+        KeyValueAVLNode<int, Libro>* node = books.find(libro.id);
+        if (node) {
+            node->value = libro;
+        } else {
+            books.insert(libro.id, libro);
+            ++count;
+        }
+    }
+
+    void eraseLocked(int id) {
+        if (books.find(id)) {
+            books.erase(id);
+            --count;
+        }
+    }
+
+    void apply(const Mutation& mutation) {
+        if (mutation.type == MutationType::Remove) {
+            eraseLocked(mutation.libro.id);
+        } else {
+            upsertLocked(mutation.libro);
+        }
+    }
+
+    void loadCsv(const string& path) {
+        ifstream file(path);
+        if (!file) {
+            throw runtime_error("Error al abrir el archivo " + path);
+        }
+        string line;
+        while (getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty()) {
+                upsertLocked(parseLibro(line));
+            }
+        }
+    }
+
+    // Writes the snapshot atomically; the caller holds the lock
+    void writeSnapshot() {
+        string temporary = snapshotPath + ".tmp";
+        {
+            ofstream out(temporary, ios::binary | ios::trunc);
+            for (const KeyValueAVLNode<int, Libro>* node = books.size() ? books.find_min() : nullptr; node;
+                 node = KeyValueAVLTree<int, Libro>::successor(node)) {
+                out << formatLibro(node->value) << '\n';
+            }
+            if (!out) {
+                throw runtime_error("No se pudo escribir el snapshot " + temporary);
+            }
+        }
+#if defined(__linux__)
+        int fd = ::open(temporary.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            ::close(fd);
+        }
+#endif
+        if (rename(temporary.c_str(), snapshotPath.c_str()) != 0) {
+            throw runtime_error("No se pudo reemplazar el snapshot " + snapshotPath);
+        }
+#if defined(__linux__)
+        string directory = snapshotPath.substr(0, snapshotPath.find_last_of('/') + 1);
+        int dirFd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+        if (dirFd >= 0) {
+            fsync(dirFd);
+            ::close(dirFd);
+        }
+#endif
+    }
+
+    // Whether the id exists once every mutation in flight is applied
+    bool existsLocked(int id) {
+        for (auto it = inFlight.rbegin(); it != inFlight.rend(); ++it) {
+            if (it->second.libro.id == id) {
+                return it->second.type != MutationType::Remove;
+            }
+        }
+        return books.find(id) != nullptr;
+    }
+
+    // Applies, in order, the mutations in flight up to `lsn`, which must all be durable
+    void applyDurableLocked(unsigned long long lsn) {
+        while (!inFlight.empty() && inFlight.begin()->first <= lsn) {
+            apply(inFlight.begin()->second);
+            inFlight.erase(inFlight.begin());
+        }
+    }
+
+    unsigned long long mutate(const Mutation& mutation) {
+        unsigned long long lsn;
+        {
+            lock_guard<mutex> guard(lock);
+            bool exists = existsLocked(mutation.libro.id);
+            if (mutation.type == MutationType::Add && exists) {
+                throw invalid_argument("Ya existe un libro con el id " + to_string(mutation.libro.id));
+            }
+            if (mutation.type != MutationType::Add && !exists) {
+                throw invalid_argument("No existe un libro con el id " + to_string(mutation.libro.id));
+            }
+            lsn = wal->append(mutation);
+            inFlight.emplace(lsn, mutation);
+        }
+        try {
+            wal->waitDurable(lsn);
+        } catch (...) {
+            lock_guard<mutex> guard(lock);
+            inFlight.erase(lsn);
+            throw;
+        }
+
+        lock_guard<mutex> guard(lock);
+        applyDurableLocked(lsn);
+        if (checkpointEvery > 0 && ++sinceCheckpoint >= checkpointEvery) {
+            checkpointLocked();
+        }
+        return lsn;
+    }
+
+    // The snapshot must hold every record the truncation drops, so what is in flight is applied first
+    void checkpointLocked() {
+        applyDurableLocked(wal->flush());
+        writeSnapshot();
+        wal->truncate();
+        sinceCheckpoint = 0;
+    }
+
+public:
+    /*
+     * Recovers the catalog stored in `directory`: the last snapshot, or `seedCsv` if there is none
+     * yet, with the log replayed on top.
+     */
+    CatalogStore(const string& directory, const string& seedCsv, unsigned long long checkpointEvery = 10000)
+        : snapshotPath(directory + "/catalogo.snapshot.csv"), checkpointEvery(checkpointEvery) {
+        auto start = chrono::steady_clock::now();
+        filesystem::create_directories(directory);
+        ifstream snapshot(snapshotPath);
+        bool hasSnapshot = snapshot.good();
+        snapshot.close();
+        loadCsv(hasSnapshot ? snapshotPath : seedCsv);
+        snapshotBooks = count;
+
+        wal.reset(new WriteAheadLog(directory + "/catalogo.wal"));
+        replayed = wal->replay([&](const Mutation& mutation) { apply(mutation); });
+        recoverySeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        if (!hasSnapshot) {
+            lock_guard<mutex> guard(lock);
+            writeSnapshot();
+        }
+    }
+
+    CatalogStore(const CatalogStore&) = delete;
+    CatalogStore& operator=(const CatalogStore&) = delete;
+
+    // Each returns once the mutation is durable; add fails if the id exists, the others if it does not
+    unsigned long long add(const Libro& libro) {
+        return mutate({MutationType::Add, libro});
+    }
+
+    unsigned long long update(const Libro& libro) {
+        return mutate({MutationType::Update, libro});
+    }
+
+    unsigned long long remove(int id) {
+        Mutation mutation{MutationType::Remove, Libro()};
+        mutation.libro.id = id;
+        return mutate(mutation);
+    }
+
+    void checkpoint() {
+        lock_guard<mutex> guard(lock);
+        checkpointLocked();
+    }
+
+    unsigned long long size() {
+        lock_guard<mutex> guard(lock);
+        return count;
+    }
+
+    // Copies the books in id order, which is the row order of the original CSV
+    void copyTo(SegmentedDynamicArray<Libro>& destination) {
+        lock_guard<mutex> guard(lock);
+        if (count == 0) {
+            return;
+        }
+        for (const KeyValueAVLNode<int, Libro>* node = books.find_min(); node;
+             node = KeyValueAVLTree<int, Libro>::successor(node)) {
+            destination.push_back(node->value);
+        }
+    }
+
+    unsigned long long booksInSnapshot() const { return snapshotBooks; }
+    unsigned long long mutationsReplayed() const { return replayed; }
+    double recoveryTime() const { return recoverySeconds; }
+
+    WriteAheadLog& log() {
+        return *wal;
+    }
+};
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef COMPRESSED_SIMILARITY_GRAPH_HPP
+#define COMPRESSED_SIMILARITY_GRAPH_HPP
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <algorithm>
+#include "DynamicArray_SR.hpp"
+#include "QuantizedSimilarityGraph.hpp"
+
+using namespace std;
+
+/*
+ * Similarity graph with compressed adjacency lists, in the style of WebGraph.
+ *
+ * The neighbors of each book are sorted and written to a byte stream as varint gaps. A list can
+ * also reference one of the previous `window` lists: a bitmap tells which neighbors of the
+ * reference are copied and only the remaining ones are gap-encoded. Reference chains are
+ * limited to maxChain steps to keep decoding fast. The byte offset of every list is kept in an
+ * index for random access. Weights are quantized and packed with the minimum number of bits per
+ * edge, in the same order as the sorted neighbors.
+ *
+ * List layout: degree, reference distance (0 = none), [copy bitmap], residual gaps.
+ */
+class CompressedSimilarityGraph {
+    WeightQuantizer quantizer;
+    int window;
+    int maxChain;
+
+    vector<string> titles;                  // Title of each book, by index
+    unordered_map<string, int> titleIndex;  // Title -> index of the book
+
+    DynamicArray<unsigned char, HugePageAllocation> stream;         // Encoded adjacency lists
+    DynamicArray<unsigned int, HugePageAllocation> listOffset;      // Byte offset of each list, plus the end
+    DynamicArray<unsigned int, HugePageAllocation> edgeOffset;      // Index of the first weight of each list
+    DynamicArray<unsigned char, HugePageAllocation> weightBits;     // Packed quantized levels
+    int bitsPerLevel = 0;
+    unsigned int referencedLists = 0;
+
+    static void writeVarint(vector<unsigned char>& out, unsigned int value) {
+        while (value >= 0x80) {
+            out.push_back((unsigned char)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((unsigned char)value);
+    }
+
+    unsigned int readVarint(unsigned int& pos) const {
+        unsigned int value = 0;
+        int shift = 0;
+        while (true) {
+            unsigned char byte = stream[pos++];
+            value |= (unsigned int)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+            shift += 7;
+        }
+    }
+
+    // Encodes the sorted list of node `book`, optionally copying from the list `reference` at distance `distance`
+    static void encode(vector<unsigned char>& out, unsigned int book, const vector<unsigned int>& list,
+                       const vector<unsigned int>* reference, unsigned int distance) {
+        writeVarint(out, (unsigned int)list.size());
+        writeVarint(out, distance);
+
+        vector<unsigned int> residuals;
+        if (reference) {
+            // Copy bitmap over the reference list, merged against the sorted list
+            vector<unsigned char> bitmap((reference->size() + 7) / 8, 0);
+            size_t i = 0;
+            for (size_t r = 0; r < reference->size(); ++r) {
+                while (i < list.size() && list[i] < (*reference)[r]) {
+                    residuals.push_back(list[i++]);
+                }
+                if (i < list.size() && list[i] == (*reference)[r]) {
+                    bitmap[r / 8] |= (unsigned char)(1 << (r % 8));
+                    ++i;
+                }
+            }
+            while (i < list.size()) {
+                residuals.push_back(list[i++]);
+            }
+            out.insert(out.end(), bitmap.begin(), bitmap.end());
+        }
+        else {
+            residuals = list;
+        }
+
+        // First residual relative to the node itself (zigzag), the rest as gaps minus one
+        for (size_t r = 0; r < residuals.size(); ++r) {
+            if (r == 0) {
+                long long delta = (long long)residuals[0] - (long long)book;
+                writeVarint(out, (unsigned int)(delta >= 0 ? 2 * delta : -2 * delta - 1));
+            }
+            else {
+                writeVarint(out, residuals[r] - residuals[r - 1] - 1);
+            }
+        }
+    }
+
+    void setLevel(unsigned int edge, unsigned char level) {
+        for (int b = 0; b < bitsPerLevel; ++b) {
+            if (level & (1 << b)) {
+                unsigned long long bit = (unsigned long long)edge * bitsPerLevel + b;
+                weightBits[(unsigned int)(bit / 8)] |= (unsigned char)(1 << (bit % 8));
+            }
+        }
+    }
+
+    unsigned char getLevel(unsigned int edge) const {
+        unsigned char level = 0;
+        for (int b = 0; b < bitsPerLevel; ++b) {
+            unsigned long long bit = (unsigned long long)edge * bitsPerLevel + b;
+            if (weightBits[(unsigned int)(bit / 8)] & (1 << (bit % 8))) {
+                level |= (unsigned char)(1 << b);
+            }
+        }
+        return level;
+    }
+
+public:
+    explicit CompressedSimilarityGraph(const WeightQuantizer& quantizer = WeightQuantizer(), int window = 7, int maxChain = 3)
+        : quantizer(quantizer), window(window), maxChain(maxChain) {}
+
+    // Builds the graph from the books and any graph whose neighbors(i) returns (index, 1 - similarity) pairs
+    template <typename Container, typename Source>
+    void build(const Container& libros, const Source& graph) {
+        titles.clear();
+        titleIndex.clear();
+        stream.clear();
+        listOffset.clear();
+        edgeOffset.clear();
+        weightBits.clear();
+        referencedLists = 0;
+
+        bitsPerLevel = 0;
+        while ((1 << bitsPerLevel) < quantizer.levelCount()) {
+            ++bitsPerLevel;
+        }
+
+        unsigned int n = libros.size();
+        vector<vector<unsigned int>> recent(window > 0 ? window : 1);  // Last lists, by index modulo window
+        vector<int> chain(n, 0);                                         // Reference chain length of each list
+        vector<unsigned char> best, candidate;
+        unsigned int edges = 0;
+
+        for (unsigned int i = 0; i < n; ++i) {
+            titles.push_back(libros[i].title);
+            titleIndex.emplace(libros[i].title, (int)i);
+
+            auto adjacent = graph.neighbors((int)i);
+            sort(adjacent.begin(), adjacent.end());
+            vector<unsigned int> list;
+            list.reserve(adjacent.size());
+            for (const auto& neighbor : adjacent) {
+                list.push_back((unsigned int)neighbor.first);
+            }
+
+            // Plain encoding, then try every list in the window as a reference
+            best.clear();
+            encode(best, i, list, nullptr, 0);
+            for (int d = 1; d <= window && (unsigned int)d <= i; ++d) {
+                unsigned int r = i - d;
+                if (chain[r] >= maxChain || recent[r % window].empty()) {
+                    continue;
+                }
+                candidate.clear();
+                encode(candidate, i, list, &recent[r % window], (unsigned int)d);
+                if (candidate.size() < best.size()) {
+                    best.swap(candidate);
+                    chain[i] = chain[r] + 1;
+                }
+            }
+            if (chain[i] > 0) {
+                ++referencedLists;
+            }
+
+            listOffset.push_back(stream.size());
+            stream.insert(stream.size(), best.data(), (unsigned int)best.size());
+
+            edgeOffset.push_back(edges);
+            unsigned long long bits = (unsigned long long)(edges + list.size()) * bitsPerLevel;
+            weightBits.resize((unsigned int)((bits + 7) / 8), 0);
+            for (const auto& neighbor : adjacent) {
+                setLevel(edges++, quantizer.quantize(1.0 - neighbor.second));
+            }
+
+            if (window > 0) {
+                recent[i % window] = list;
+            }
+        }
+        listOffset.push_back(stream.size());
+        edgeOffset.push_back(edges);
+    }
+
+    int size() const {
+        return (int)titles.size();
+    }
+
+    size_t edgeCount() const {
+        return titles.empty() ? 0 : edgeOffset[titles.size()] / 2;
+    }
+
+    // Decodes the sorted neighbor list of a book, following its reference if it has one
+    vector<unsigned int> neighborIds(int book) const {
+        unsigned int pos = listOffset[book];
+        unsigned int degree = readVarint(pos);
+        unsigned int distance = readVarint(pos);
+
+        vector<unsigned int> copied;
+        if (distance > 0) {
+            vector<unsigned int> reference = neighborIds(book - (int)distance);
+            for (size_t r = 0; r < reference.size(); ++r) {
+                if (stream[pos + (unsigned int)(r / 8)] & (1 << (r % 8))) {
+                    copied.push_back(reference[r]);
+                }
+            }
+            pos += (unsigned int)((reference.size() + 7) / 8);
+        }
+
+        vector<unsigned int> residuals;
+        residuals.reserve(degree - copied.size());
+        for (size_t r = copied.size(); r < degree; ++r) {
+            unsigned int value = readVarint(pos);
+            if (residuals.empty()) {
+                long long delta = (value & 1) ? -(long long)((value + 1) / 2) : (long long)(value / 2);
+                residuals.push_back((unsigned int)(book + delta));
+            }
+            else {
+                residuals.push_back(residuals.back() + value + 1);
+            }
+        }
+
+        vector<unsigned int> list(degree);
+        merge(copied.begin(), copied.end(), residuals.begin(), residuals.end(), list.begin());
+        return list;
+    }
+
+    // Returns (neighbor index, weight) pairs in ascending index order, with weight = 1 - similarity
+    vector<pair<int, double>> neighbors(int book) const {
+        vector<unsigned int> ids = neighborIds(book);
+        vector<pair<int, double>> result;
+        result.reserve(ids.size());
+        unsigned int edge = edgeOffset[book];
+        for (unsigned int id : ids) {
+            result.emplace_back((int)id, 1.0 - quantizer.dequantize(getLevel(edge++)));
+        }
+        return result;
+    }
+
+    // Adjacency entries: every undirected edge is stored once in each direction
+    size_t arcCount() const {
+        return titles.empty() ? 0 : edgeOffset[titles.size()];
+    }
+
+    // Size of the adjacency stream, in bits per arc
+    double bitsPerArc() const {
+        size_t arcs = arcCount();
+        return arcs == 0 ? 0.0 : 8.0 * stream.size() / arcs;
+    }
+
+    // Size of the packed weights and the offset index, in bits per arc
+    double overheadBitsPerArc() const {
+        size_t arcs = arcCount();
+        return arcs == 0 ? 0.0 : 8.0 * (weightBits.size() + 4.0 * (listOffset.size() + edgeOffset.size())) / arcs;
+    }
+
+    void displayStats() const {
+        cout << "Grafo comprimido: " << size() << " libros, " << edgeCount() << " aristas (" << arcCount()
+             << " arcos), " << referencedLists << " listas con referencia\n";
+        cout << "Bits por arco: " << bitsPerArc() << " (adyacencia) + "
+             << overheadBitsPerArc() << " (pesos e indice)\n";
+    }
+
+    void displayAdjacent(const string& book) const {
+        auto it = titleIndex.find(book);
+        vector<pair<int, double>> adjacent;
+        if (it != titleIndex.end()) {
+            adjacent = neighbors(it->second);
+        }
+
+        if (!adjacent.empty()) {
+            cout << "Libros adyacentes a \"" << book << "\":" << endl;
+            for (const auto& neighbor : adjacent) {
+                cout << " - " << titles[neighbor.first] << " (peso: " << neighbor.second << ")" << endl;
+            }
+        } else {
+            cout << "El libro \"" << book << "\" no tiene libros adyacentes o no esta en el grafo." << endl;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,443 @@
+#ifndef DISTRIBUTED_GRAPH_BUILD_HPP
+#define DISTRIBUTED_GRAPH_BUILD_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <filesystem>
+#include <stdexcept>
+#include "WeightedUndirectedGraph.hpp"
+#include "ExternalGraphBuilder.hpp"
+#include "CatalogReader.hpp"
+
+#if defined(__linux__)
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+using namespace std;
+
+/*
+ * A candidate block: the books of one (author, genre), (author, date) or (genre, date) group, in
+ * ascending order. Two books can only reach a threshold above 0.3 if they share two attributes,
+ * so every edge of the graph is a pair inside some block.
+ */
+struct CandidateBlock {
+    int relation;
+    vector<unsigned int> books;
+
+    unsigned long long pairs() const {
+        return (unsigned long long)books.size() * (books.size() - 1) / 2;
+    }
+};
+
+template <typename Container>
+vector<CandidateBlock> candidateBlocks(const Container& libros) {
+    const char SEP = '\x1f';
+    unordered_map<string, unsigned int> groups[3];
+    vector<CandidateBlock> blocks;
+    for (unsigned int i = 0; i < libros.size(); ++i) {
+        const string keys[3] = {
+            libros[i].author + SEP + libros[i].genre,
+            libros[i].author + SEP + libros[i].publication_date,
+            libros[i].genre + SEP + libros[i].publication_date
+        };
+        for (int r = 0; r < 3; ++r) {
+            auto inserted = groups[r].emplace(keys[r], (unsigned int)blocks.size());
+            if (inserted.second) {
+                blocks.push_back({r, {}});
+            }
+            blocks[inserted.first->second].books.push_back(i);
+        }
+    }
+
+    // Single books have no pairs to score
+    blocks.erase(remove_if(blocks.begin(), blocks.end(), [](const CandidateBlock& b) { return b.books.size() < 2; }),
+                 blocks.end());
+    return blocks;
+}
+
+// Part of a block: the pairs whose first book is at positions [first, last) of the block
+struct BlockTask {
+    size_t block;
+    size_t first;
+    size_t last;
+    unsigned long long pairs;
+};
+
+/*
+ * Splits the blocks among the workers by their number of pairs: largest first, each to the
+ * worker with the least work so far. Blocks bigger than a fraction of a worker's share are cut
+ * into ranges of rows first, otherwise one large group would bound the speedup.
+ */
+inline vector<vector<BlockTask>> assignBlocks(const vector<CandidateBlock>& blocks, int workers) {
+    unsigned long long total = 0;
+    for (const CandidateBlock& block : blocks) {
+        total += block.pairs();
+    }
+    unsigned long long target = max<unsigned long long>(1, total / ((unsigned long long)workers * 8));
+
+    vector<BlockTask> tasks;
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        size_t size = blocks[b].books.size();
+        size_t first = 0;
+        unsigned long long pairs = 0;
+        for (size_t x = 0; x < size; ++x) {
+            pairs += size - 1 - x;
+            if (pairs >= target || x + 1 == size) {
+                tasks.push_back({b, first, x + 1, pairs});
+                first = x + 1;
+                pairs = 0;
+            }
+        }
+    }
+    stable_sort(tasks.begin(), tasks.end(), [](const BlockTask& a, const BlockTask& b) { return a.pairs > b.pairs; });
+
+    vector<vector<BlockTask>> assignment(workers);
+    vector<unsigned long long> load(workers, 0);
+    for (const BlockTask& task : tasks) {
+        int lightest = (int)(min_element(load.begin(), load.end()) - load.begin());
+        assignment[lightest].push_back(task);
+        load[lightest] += task.pairs + 1;
+    }
+    return assignment;
+}
+
+/*
+ * Builds the CSR similarity graph with worker processes. The coordinator groups the books into
+ * candidate blocks and assigns them; each worker scores the pairs of its blocks with
+ * calculateSimilarity and writes its edges as sorted runs in its own directory. The coordinator
+ * then merges every run into the CSR, which comes out byte for byte the same as the one built by
+ * comparing all pairs in a single process.
+ *
+ * A pair can be in up to three blocks, so it is only scored in the first relation it shares:
+ * (author, date) skips pairs with the same genre and (genre, date) pairs with the same author.
+ *
+ * run() may be called from any thread, so the workers are not forks of the coordinator: each is
+ * a fresh exec of this program (/proc/self/exe) with WORKER_FLAG, which must be dispatched to
+ * runWorker() before anything else in main. The coordinator writes the books to libros.csv and
+ * each worker's blocks to trabajador_<w>.tareas in the work directory; a worker reports its
+ * counters through a pipe on descriptor 3.
+ */
+class DistributedGraphBuild {
+    struct WorkerStats {
+        unsigned long long tasks = 0;
+        unsigned long long pairs = 0;
+        unsigned long long edges = 0;
+        double cpuSeconds = 0;
+    };
+
+    string workDir;
+    int workers;
+    size_t memoryBudget;
+    vector<WorkerStats> stats;
+    size_t blockCount = 0;
+    double scoreSeconds = 0;
+    double mergeSeconds = 0;
+
+    string workerDir(int worker) const {
+        return workDir + "/trabajador_" + to_string(worker);
+    }
+
+    static string booksPath(const string& workDir) {
+        return workDir + "/libros.csv";
+    }
+
+    static string tasksPath(const string& workDir, int worker) {
+        return workDir + "/trabajador_" + to_string(worker) + ".tareas";
+    }
+
+    /*
+     * Task file of a worker:
+     *
+     *   double threshold, uint64 memory budget, uint64 task count, then per task
+     *   int32 relation, uint64 first, uint64 last, uint64 book count, uint32 books[count]
+     *
+     * Each task carries its own copy of the block, so the worker needs no block numbering.
+     */
+    void writeTasks(int worker, const vector<CandidateBlock>& blocks, const vector<BlockTask>& assigned,
+                    double threshold) const {
+        string path = tasksPath(workDir, worker);
+        ofstream out(path, ios::binary | ios::trunc);
+        unsigned long long budget = memoryBudget / workers, count = assigned.size();
+        out.write(reinterpret_cast<const char*>(&threshold), sizeof(threshold));
+        out.write(reinterpret_cast<const char*>(&budget), sizeof(budget));
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (const BlockTask& task : assigned) {
+            const CandidateBlock& block = blocks[task.block];
+            unsigned long long first = task.first, last = task.last, books = block.books.size();
+            out.write(reinterpret_cast<const char*>(&block.relation), sizeof(block.relation));
+            out.write(reinterpret_cast<const char*>(&first), sizeof(first));
+            out.write(reinterpret_cast<const char*>(&last), sizeof(last));
+            out.write(reinterpret_cast<const char*>(&books), sizeof(books));
+            out.write(reinterpret_cast<const char*>(block.books.data()), books * sizeof(unsigned int));
+        }
+        if (!out) {
+            throw runtime_error("No se pudo escribir el archivo temporal " + path);
+        }
+    }
+
+    template <typename Container>
+    static WorkerStats scoreBlocks(const Container& libros, const vector<CandidateBlock>& blocks,
+                                   const vector<BlockTask>& assigned, double threshold, ExternalGraphBuilder& output) {
+        WorkerStats worker;
+        for (const BlockTask& task : assigned) {
+            const CandidateBlock& block = blocks[task.block];
+            ++worker.tasks;
+            for (size_t x = task.first; x < task.last; ++x) {
+                const Libro& first = libros[block.books[x]];
+                for (size_t y = x + 1; y < block.books.size(); ++y) {
+                    const Libro& second = libros[block.books[y]];
+                    if ((block.relation == 1 && first.genre == second.genre) ||
+                        (block.relation == 2 && first.author == second.author)) {
+                        continue;
+                    }
+                    ++worker.pairs;
+                    double similarity = calculateSimilarity(first, second);
+                    if (similarity >= threshold) {
+                        output.addEdge(block.books[x], block.books[y], 1.0 - similarity);
+                        ++worker.edges;
+                    }
+                }
+            }
+        }
+        return worker;
+    }
+
+public:
+    static constexpr const char* WORKER_FLAG = "--trabajador-grafo";
+    static const int REPORT_FD = 3;
+
+    /*
+     * Body of a worker process started by run(): scores the blocks of trabajador_<worker>.tareas
+     * and leaves the sorted runs in its directory. Returns the exit status.
+     */
+    static int runWorker(const string& workDir, int worker) {
+        try {
+            // CPU time, so it shows each worker's share even when there are fewer cores than
+            // workers; it includes sorting and writing the partitions
+            clock_t started = clock();
+            vector<Libro> libros;
+            {
+                ifstream in(booksPath(workDir));
+                string line;
+                while (getline(in, line)) {
+                    libros.push_back(parseLibro(line));
+                }
+            }
+
+            ifstream in(tasksPath(workDir, worker), ios::binary);
+            double threshold;
+            unsigned long long budget, count;
+            in.read(reinterpret_cast<char*>(&threshold), sizeof(threshold));
+            in.read(reinterpret_cast<char*>(&budget), sizeof(budget));
+            in.read(reinterpret_cast<char*>(&count), sizeof(count));
+            if (!in) {
+                throw runtime_error("Tareas invalidas: " + tasksPath(workDir, worker));
+            }
+            vector<CandidateBlock> blocks;
+            vector<BlockTask> tasks;
+            for (unsigned long long t = 0; t < count; ++t) {
+                CandidateBlock block;
+                unsigned long long first, last, books;
+                in.read(reinterpret_cast<char*>(&block.relation), sizeof(block.relation));
+                in.read(reinterpret_cast<char*>(&first), sizeof(first));
+                in.read(reinterpret_cast<char*>(&last), sizeof(last));
+                in.read(reinterpret_cast<char*>(&books), sizeof(books));
+                if (!in || books > libros.size() || last > books || first > last) {
+                    throw runtime_error("Tareas invalidas: " + tasksPath(workDir, worker));
+                }
+                block.books.resize(books);
+                in.read(reinterpret_cast<char*>(block.books.data()), books * sizeof(unsigned int));
+                for (unsigned int book : block.books) {
+                    if (book >= libros.size()) {
+                        throw runtime_error("Tareas invalidas: " + tasksPath(workDir, worker));
+                    }
+                }
+                tasks.push_back({blocks.size(), first, last, 0});
+                blocks.push_back(std::move(block));
+            }
+            if (!in) {
+                throw runtime_error("Tareas invalidas: " + tasksPath(workDir, worker));
+            }
+
+            ExternalGraphBuilder output(workDir + "/trabajador_" + to_string(worker), budget);
+            WorkerStats report = scoreBlocks(libros, blocks, tasks, threshold, output);
+            output.releaseRuns();
+            report.cpuSeconds = (double)(clock() - started) / CLOCKS_PER_SEC;
+#if defined(__linux__)
+            if (write(REPORT_FD, &report, sizeof(report)) != (ssize_t)sizeof(report)) {
+                return 1;
+            }
+#endif
+            return 0;
+        } catch (const exception& e) {
+            cerr << "Trabajador " << worker << ": " << e.what() << endl;
+            return 1;
+        }
+    }
+
+    DistributedGraphBuild(const string& workDir, int workers, size_t memoryBudgetBytes = 64u << 20)
+        : workDir(workDir), workers(max(1, workers)), memoryBudget(memoryBudgetBytes) {}
+
+    // Builds the graph of `libros` at csrPath; the threshold must be above 0.3 for the blocks to cover every edge
+    template <typename Container>
+    void run(const Container& libros, double threshold, const string& csrPath) {
+        if (threshold <= 0.3) {
+            throw runtime_error("La construccion distribuida requiere un umbral mayor que 0.3");
+        }
+#if defined(__linux__)
+        vector<CandidateBlock> blocks = candidateBlocks(libros);
+        vector<vector<BlockTask>> assignment = assignBlocks(blocks, workers);
+        blockCount = blocks.size();
+        stats.assign(workers, WorkerStats());
+
+        {
+            ofstream out(booksPath(workDir), ios::binary | ios::trunc);
+            for (unsigned int i = 0; i < libros.size(); ++i) {
+                out << formatLibro(libros[i]) << '\n';
+            }
+            if (!out) {
+                throw runtime_error("No se pudo escribir el archivo temporal " + booksPath(workDir));
+            }
+        }
+        for (int w = 0; w < workers; ++w) {
+            filesystem::remove_all(workerDir(w));
+            filesystem::create_directories(workerDir(w));
+            writeTasks(w, blocks, assignment[w], threshold);
+        }
+
+        // Each worker reports its counters through a pipe and exits with 0 once its runs are on disk
+        auto start = chrono::steady_clock::now();
+        vector<pid_t> pids;
+        vector<int> reports;
+        // On a failure to start a worker the ones already running are stopped and reaped
+        auto abandon = [&](const string& error) {
+            for (size_t w = 0; w < pids.size(); ++w) {
+                close(reports[w]);
+                kill(pids[w], SIGTERM);
+                waitpid(pids[w], nullptr, 0);
+            }
+            throw runtime_error(error);
+        };
+        string program = "/proc/self/exe";
+        for (int w = 0; w < workers; ++w) {
+            int channel[2];
+            if (pipe2(channel, O_CLOEXEC) != 0) {
+                abandon("No se pudo crear el canal de un trabajador");
+            }
+            if (channel[1] == REPORT_FD) {
+                // dup2 onto itself would keep close-on-exec set
+                int moved = fcntl(channel[1], F_DUPFD_CLOEXEC, REPORT_FD + 1);
+                close(channel[1]);
+                channel[1] = moved;
+                if (moved < 0) {
+                    close(channel[0]);
+                    abandon("No se pudo crear el canal de un trabajador");
+                }
+            }
+            string index = to_string(w);
+            char* argv[] = {const_cast<char*>(program.c_str()), const_cast<char*>(WORKER_FLAG),
+                            const_cast<char*>(workDir.c_str()), const_cast<char*>(index.c_str()), nullptr};
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            // dup2 clears close-on-exec on descriptor 3; the pipe ends themselves close at exec
+            posix_spawn_file_actions_adddup2(&actions, channel[1], REPORT_FD);
+            pid_t pid;
+            int error = posix_spawn(&pid, program.c_str(), &actions, nullptr, argv, environ);
+            posix_spawn_file_actions_destroy(&actions);
+            close(channel[1]);
+            if (error != 0) {
+                close(channel[0]);
+                abandon("No se pudo iniciar un trabajador");
+            }
+            pids.push_back(pid);
+            reports.push_back(channel[0]);
+        }
+
+        string failure;
+        for (int w = 0; w < workers; ++w) {
+            if (read(reports[w], &stats[w], sizeof(WorkerStats)) != (ssize_t)sizeof(WorkerStats)) {
+                failure = "El trabajador " + to_string(w) + " no termino";
+            }
+            close(reports[w]);
+            int status = 0;
+            waitpid(pids[w], &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                failure = "El trabajador " + to_string(w) + " fallo";
+            }
+        }
+        if (!failure.empty()) {
+            throw runtime_error(failure);
+        }
+        scoreSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        // Merge step: every partition is sorted, so the CSR does not depend on how blocks were split
+        start = chrono::steady_clock::now();
+        ExternalGraphBuilder merger(workDir, memoryBudget);
+        for (int w = 0; w < workers; ++w) {
+            vector<string> partitions;
+            for (const auto& file : filesystem::directory_iterator(workerDir(w))) {
+                partitions.push_back(file.path().string());
+            }
+            sort(partitions.begin(), partitions.end());
+            for (const string& partition : partitions) {
+                merger.adoptRun(partition);
+            }
+        }
+        merger.finish(csrPath, (unsigned int)libros.size());
+        for (int w = 0; w < workers; ++w) {
+            filesystem::remove_all(workerDir(w));
+            remove(tasksPath(workDir, w).c_str());
+        }
+        remove(booksPath(workDir).c_str());
+        mergeSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+#else
+        (void)libros;
+        (void)csrPath;
+        throw runtime_error("DistributedGraphBuild requiere posix_spawn");
+#endif
+    }
+
+    void printMetrics(ostream& out) const {
+        ios::fmtflags flags = out.flags();
+        streamsize precision = out.precision();
+        unsigned long long pairs = 0, edges = 0;
+        double cpu = 0, busiest = 0;
+        for (const WorkerStats& worker : stats) {
+            pairs += worker.pairs;
+            edges += worker.edges;
+            cpu += worker.cpuSeconds;
+            busiest = max(busiest, worker.cpuSeconds);
+        }
+        out << "Grafo distribuido: " << workers << " trabajadores, " << blockCount << " bloques, "
+            << pairs << " pares comparados, " << edges << " aristas; puntuacion " << fixed << setprecision(1)
+            << scoreSeconds * 1e3 << " ms, mezcla " << mergeSeconds * 1e3 << " ms\n";
+        for (size_t w = 0; w < stats.size(); ++w) {
+            out << "  trabajador " << setw(2) << w << setw(8) << stats[w].tasks << " tareas" << setw(10)
+                << stats[w].pairs << " pares" << setw(10) << stats[w].edges << " aristas" << setw(9)
+                << stats[w].cpuSeconds * 1e3 << " ms de CPU\n";
+        }
+        // With one core per worker the scoring takes as long as the busiest worker
+        if (busiest > 0) {
+            out << "  CPU total " << cpu * 1e3 << " ms, trabajador mas cargado " << busiest * 1e3
+                << " ms: aceleracion " << setprecision(2) << cpu / busiest << "x con un nucleo por trabajador\n";
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+#endif
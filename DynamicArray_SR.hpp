@@ -10,13 +10,23 @@
 // Includes
 #include <stdexcept>    // For std::out_of_range
 #include <iostream>
+#include <type_traits>  // For std::is_trivially_copyable
+#include <algorithm>    // For std::move, std::move_backward, std::copy
+#include <cstring>      // For std::memcpy, std::memmove
+#include "HugePageAllocation_SR.hpp"
 
 /**
  *  Class that defines a dynamic array.
  *
- *  @tparam T   Type of the elements in the array. 
+ *  When T is trivially copyable the storage comes from the allocation policy and elements are
+ *  shifted with memmove, so growth can extend the buffer in place and bulk edits are a single
+ *  block move. Other types use new[]/delete[] and element-wise moves.
+ *
+ *  @tparam T           Type of the elements in the array. 
+ *  @tparam Allocation  Allocation policy for trivially copyable elements, HeapAllocation or
+ *                      HugePageAllocation.
  */
-template <typename T>
+template <typename T, typename Allocation = HeapAllocation>
 class DynamicArray {
 
 public:
@@ -31,9 +41,8 @@ public:
      */
     DynamicArray(const T& value, unsigned int size) : size_(size), capacity_(size*2)
     {
-        data_ = new T[capacity_];
-        for (unsigned int i = 0; i < size_; ++i)
-            data_[i] = value;
+        data_ = allocate(capacity_);
+        std::fill(data_, data_ + size_, value);
     }
 
     /**
@@ -43,9 +52,8 @@ public:
     {
         size_ = other.size_;
         capacity_ = other.capacity_;
-        data_ = new T[capacity_];
-        for (unsigned int i = 0; i < size_; ++i)
-            data_[i] = other.data_[i];
+        data_ = allocate(capacity_);
+        copy_elements(data_, other.data_, size_);
     }    
 
     /**
@@ -53,8 +61,7 @@ public:
      */
     ~DynamicArray()
     {
-        if (data_ != nullptr)
-            delete[] data_;
+        deallocate(data_, capacity_);
     }
 
     /**
@@ -64,15 +71,12 @@ public:
     {
         if (this != &other) {
 
-            if (data_ != nullptr)
-                delete[] data_;
+            deallocate(data_, capacity_);
 
             size_ = other.size_;
             capacity_ = other.capacity_;
-            data_ = new T[capacity_];
-            
-            for (unsigned int i = 0; i < size_; ++i)
-                data_[i] = other.data_[i];
+            data_ = allocate(capacity_);
+            copy_elements(data_, other.data_, size_);
         }
 
         return *this;
@@ -218,32 +222,24 @@ public:
      */
     void clear() 
     {
-        if (data_ != nullptr)
-            delete[] data_;
+        deallocate(data_, capacity_);
 
         data_ = nullptr;
         size_ = 0;
+        capacity_ = 0;
     }    
 
     /**
-     *  Resizes the array and fills the new elements with a value.
+     *  Grows the capacity of the array. The size and the elements are kept.
      *
-     *  @param  newSize The new size of the array.
-     *  @param  value   The value to fill the new elements with.
+     *  @param  newCapacity The new capacity of the array.
      */
-
     void resize(unsigned int newCapacity)
     {
-        if (newCapacity > capacity_) {
-            T* newData = new T[newCapacity];
-            for (unsigned int i = 0; i < size_; ++i)
-                newData[i] = data_[i];
-
-            delete[] data_;
-            data_ = newData;
-            capacity_ = newCapacity;
-    }
+        if (newCapacity > capacity_)
+            reallocate(newCapacity);
     }
+
     /**
      *  Resizes the array and fills the new elements with a value.
      * 
@@ -252,50 +248,54 @@ public:
      */
     void resize(unsigned int newSize, const T& value) 
     {
-    if (newSize > capacity_) {
-        // Duplicar capacidad o establecerla a newSize, lo que sea mayor
-        unsigned int newCapacity = (newSize > capacity_ * 2) ? newSize : capacity_ * 2;
-        
-        T* newData = new T[newCapacity];
-
-        // Copiar los elementos al nuevo arreglo
-        unsigned int copySize = (newSize < size_) ? newSize : size_;
-        for (unsigned int i = 0; i < copySize; ++i)
-            newData[i] = data_[i];
+        T copy = value;     // The value may live in this array, which grow_to can release
+        grow_to(newSize);
 
         // Llenar los nuevos elementos con el valor proporcionado
-        for (unsigned int i = copySize; i < newSize; ++i)
-            newData[i] = value;
+        if (newSize > size_)
+            std::fill(data_ + size_, data_ + newSize, copy);
 
-        // Liberar el arreglo anterior y actualizar punteros
-        delete[] data_;
-        data_ = newData;
-        capacity_ = newCapacity;
+        // Actualizar el tamaño del arreglo
+        size_ = newSize;
     }
 
-    // Actualizar el tamaño del arreglo
-    size_ = newSize;
-}
-
-
     /**
      *  Inserts a new element at a specific position.
      *
      *  @param  index   The position where the element will be inserted.
+     *  @param  value   The value to insert.
      */
     void insert(unsigned int index, const T& value) 
+    {
+        T copy = value;     // The value may live in this array
+        insert(index, &copy, 1);
+    }
+
+    /**
+     *  Inserts a range of elements at a specific position. The tail of the array is
+     *  shifted once, with a single memmove for trivially copyable types.
+     *
+     *  @param  index   The position where the first element will be inserted.
+     *  @param  values  Pointer to the elements to insert. It must not point into this array.
+     *  @param  count   The number of elements to insert.
+     */
+    void insert(unsigned int index, const T* values, unsigned int count)
     {
         if (index > size_) {
             throw std::out_of_range("Index out of range");
         }
 
-        resize(size_ + 1);
+        grow_to(size_ + count);
 
-        for (unsigned int i = size_ - 1; i > index; --i) {
-            data_[i] = data_[i - 1];
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            std::memmove(data_ + index + count, data_ + index, (size_ - index) * sizeof(T));
         }
+        else {
+            std::move_backward(data_ + index, data_ + size_, data_ + size_ + count);
+        }
+        copy_elements(data_ + index, values, count);
 
-        data_[index] = value;
+        size_ += count;
     }
 
     /**
@@ -305,15 +305,30 @@ public:
      */
     void erase(unsigned int index) 
     {
-        if (index >= size_) {
+        erase(index, 1);
+    }
+
+    /**
+     *  Erases a range of elements starting at a specific position. The tail of the array
+     *  is shifted once, with a single memmove for trivially copyable types.
+     *
+     *  @param[in]  index   The position of the first element to erase.
+     *  @param[in]  count   The number of elements to erase.
+     */
+    void erase(unsigned int index, unsigned int count)
+    {
+        if (index >= size_ || count > size_ - index) {
             throw std::out_of_range("Index out of range");
         }
 
-        for (unsigned int i = index; i < size_ - 1; ++i) {
-            data_[i] = data_[i + 1];
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            std::memmove(data_ + index, data_ + index + count, (size_ - index - count) * sizeof(T));
+        }
+        else {
+            std::move(data_ + index + count, data_ + size_, data_ + index);
         }
 
-        resize(size_ - 1);
+        size_ -= count;
     }
 
     /**
@@ -324,9 +339,13 @@ public:
     void push_back(const T& value) 
     {
         if (size_ == capacity_) {
-        resize(capacity_ > 0 ? capacity_ * 2 : 1);  // Duplicar capacidad o inicializar en 1 si es 0
+            T copy = value;     // The value may live in this array
+            reallocate(capacity_ > 0 ? capacity_ * 2 : 1);  // Duplicar capacidad o inicializar en 1 si es 0
+            data_[size_] = copy;
+        }
+        else {
+            data_[size_] = value;
         }
-        data_[size_] = value;
         ++size_;
     }
 
@@ -336,7 +355,7 @@ public:
     void pop_back() 
     {
         if (size_ > 0) {
-            resize(size_ - 1);
+            --size_;
         }
     }
 
@@ -371,6 +390,86 @@ public:
 
 private:
 
+    /**
+     *  Allocates storage for a number of elements.
+     *
+     *  @param[in]  n   The number of elements.
+     *
+     *  @return Pointer to the new storage.
+     */
+    static T* allocate(unsigned int n)
+    {
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            if (n == 0)
+                return nullptr;
+            return static_cast<T*>(Allocation::allocate((size_t)n * sizeof(T)));
+        }
+        else {
+            return new T[n];
+        }
+    }
+
+    /**
+     *  Deallocates storage obtained from allocate().
+     *
+     *  @param[in]  p   Pointer to the storage, may be nullptr.
+     *  @param[in]  n   The number of elements the storage was allocated for.
+     */
+    static void deallocate(T* p, unsigned int n)
+    {
+        if constexpr (std::is_trivially_copyable<T>::value)
+            Allocation::deallocate(p, (size_t)n * sizeof(T));
+        else
+            delete[] p;
+    }
+
+    /**
+     *  Copies a number of elements between non-overlapping buffers.
+     */
+    static void copy_elements(T* dst, const T* src, unsigned int n)
+    {
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            if (n > 0)
+                std::memcpy(dst, src, (size_t)n * sizeof(T));
+        }
+        else {
+            std::copy(src, src + n, dst);
+        }
+    }
+
+    /**
+     *  Changes the capacity of the array keeping its elements. Trivially copyable types ask the
+     *  allocation policy to resize the block, which can extend it in place (the heap policy uses
+     *  realloc, and glibc remaps large blocks with mremap).
+     *
+     *  @param[in]  newCapacity The new capacity, not smaller than the size.
+     */
+    void reallocate(unsigned int newCapacity)
+    {
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            data_ = static_cast<T*>(Allocation::reallocate(data_, (size_t)capacity_ * sizeof(T),
+                                                           (size_t)newCapacity * sizeof(T)));
+        }
+        else {
+            T* newData = new T[newCapacity];
+            std::move(data_, data_ + size_, newData);
+            delete[] data_;
+            data_ = newData;
+        }
+        capacity_ = newCapacity;
+    }
+
+    /**
+     *  Ensures room for a number of elements, at least doubling the capacity when it grows.
+     *
+     *  @param[in]  needed  The number of elements that must fit.
+     */
+    void grow_to(unsigned int needed)
+    {
+        if (needed > capacity_)
+            reallocate(needed > capacity_ * 2 ? needed : capacity_ * 2);
+    }
+
     T* data_{nullptr};      // Pointer to the dynamic array
 
     unsigned int size_{0};  // Current size of the array
@@ -0,0 +1,562 @@
+#ifndef EXTERNAL_GRAPH_BUILDER_HPP
+#define EXTERNAL_GRAPH_BUILDER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <queue>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <stdexcept>
+#include <filesystem>
+#include "HugePageAllocation_SR.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/*
+ * CSR graph file written by ExternalGraphBuilder:
+ *
+ *   char[8]            magic "SRCSR01"
+ *   uint64             number of nodes n
+ *   uint64             number of directed entries m (each undirected edge appears twice)
+ *   uint64[n + 1]      offset of the first entry of each node
+ *   uint32[m]          target of each entry, ascending within each node
+ *   (padding to 8 bytes)
+ *   double[m]          weight of each entry
+ */
+const char CSR_MAGIC[8] = "SRCSR01";
+
+/*
+ * Checkpoint of a build in progress (workDir/checkpoint.bin), replaced atomically:
+ *
+ *   char[8]            magic "SRCKP01"
+ *   uint64             fingerprint of the build (catalog and parameters)
+ *   uint64             position reported by the caller, COMPLETE once every edge was added
+ *   uint64             directed entries in the runs
+ *   uint32             number of the next run file
+ *   uint32             number of runs, followed by the file name of each one (uint32 length, bytes)
+ */
+const char CHECKPOINT_MAGIC[8] = "SRCKP01";
+
+struct EdgeRecord {
+    unsigned int source;
+    unsigned int target;
+    double weight;
+
+    bool operator<(const EdgeRecord& other) const {
+        return source != other.source ? source < other.source : target < other.target;
+    }
+};
+
+/*
+ * Out-of-core builder for the similarity graph.
+ *
+ * Edges are buffered up to the memory budget, sorted and written as runs to the work directory.
+ * finish() merges the runs (in several passes if there are more than the budget allows to open
+ * at once) and streams the result directly into a CSR file. Peak memory is the budget plus the
+ * n + 1 offsets of the CSR header, no matter how many edges the threshold admits.
+ */
+class ExternalGraphBuilder {
+    string workDir;
+    size_t bufferCapacity;      // Edge records held in memory before spilling a run
+    size_t maxFanIn;            // Runs merged at once
+    vector<EdgeRecord, PolicyAllocator<EdgeRecord, HugePageAllocation>> buffer;   // Sorted in place for every run
+    vector<string> runs;
+    int nextRun = 0;
+    unsigned long long entries = 0;
+    bool checkpointing = false;
+    unsigned long long fingerprint = 0;
+
+    string runPath() {
+        return workDir + "/run_" + to_string(nextRun++) + ".bin";
+    }
+
+    string checkpointPath() const {
+        return workDir + "/checkpoint.bin";
+    }
+
+    // Flushes a file (or directory) to disk; without it a rename could survive a crash its data did not
+    static void syncPath(const string& path) {
+#if defined(__linux__)
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0 || fsync(fd) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw runtime_error("No se pudo sincronizar " + path);
+        }
+        close(fd);
+#else
+        (void)path;
+#endif
+    }
+
+    void writeCheckpoint(unsigned long long position) {
+        string tmpPath = checkpointPath() + ".tmp";
+        {
+            ofstream out(tmpPath, ios::binary | ios::trunc);
+            unsigned int next = (unsigned int)nextRun, count = (unsigned int)runs.size();
+            out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+            out.write(reinterpret_cast<const char*>(&fingerprint), sizeof(fingerprint));
+            out.write(reinterpret_cast<const char*>(&position), sizeof(position));
+            out.write(reinterpret_cast<const char*>(&entries), sizeof(entries));
+            out.write(reinterpret_cast<const char*>(&next), sizeof(next));
+            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            for (const string& path : runs) {
+                string name = filesystem::path(path).filename().string();
+                unsigned int length = (unsigned int)name.size();
+                out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+                out.write(name.data(), length);
+            }
+            if (!out) {
+                throw runtime_error("No se pudo escribir el checkpoint " + tmpPath);
+            }
+        }
+        syncPath(tmpPath);
+        if (rename(tmpPath.c_str(), checkpointPath().c_str()) != 0) {
+            throw runtime_error("No se pudo reemplazar el checkpoint " + checkpointPath());
+        }
+        syncPath(workDir);
+    }
+
+    // Loads the checkpoint if it belongs to this build and every run it lists is intact
+    bool readCheckpoint(unsigned long long& position) {
+        ifstream in(checkpointPath(), ios::binary);
+        char magic[sizeof(CHECKPOINT_MAGIC)];
+        unsigned long long savedFingerprint = 0, savedEntries = 0;
+        unsigned int next = 0, count = 0;
+        if (!in.read(magic, sizeof(magic)) || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+            return false;
+        }
+        in.read(reinterpret_cast<char*>(&savedFingerprint), sizeof(savedFingerprint));
+        in.read(reinterpret_cast<char*>(&position), sizeof(position));
+        in.read(reinterpret_cast<char*>(&savedEntries), sizeof(savedEntries));
+        in.read(reinterpret_cast<char*>(&next), sizeof(next));
+        in.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!in || savedFingerprint != fingerprint) {
+            return false;
+        }
+
+        vector<string> savedRuns;
+        unsigned long long records = 0;
+        for (unsigned int r = 0; r < count; ++r) {
+            unsigned int length = 0;
+            if (!in.read(reinterpret_cast<char*>(&length), sizeof(length)) || length > 4096) {
+                return false;
+            }
+            string name(length, '\0');
+            if (!in.read(&name[0], length)) {
+                return false;
+            }
+            error_code ec;
+            unsigned long long bytes = filesystem::file_size(workDir + "/" + name, ec);
+            if (ec || bytes % sizeof(EdgeRecord) != 0) {
+                return false;
+            }
+            records += bytes / sizeof(EdgeRecord);
+            savedRuns.push_back(workDir + "/" + name);
+        }
+        if (records != savedEntries) {
+            return false;
+        }
+
+        runs = savedRuns;
+        entries = savedEntries;
+        nextRun = (int)next;
+        return true;
+    }
+
+    void spill() {
+        if (buffer.empty()) {
+            return;
+        }
+        sort(buffer.begin(), buffer.end());
+        string path = runPath();
+        ofstream out(path, ios::binary);
+        out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(EdgeRecord));
+        if (!out) {
+            throw runtime_error("No se pudo escribir el archivo temporal " + path);
+        }
+        out.close();
+        if (checkpointing) {
+            syncPath(path);
+        }
+        runs.push_back(path);
+        buffer.clear();
+    }
+
+    // Reads a run sequentially through a small buffer
+    struct RunReader {
+        ifstream in;
+        vector<EdgeRecord> block;
+        size_t count = 0;
+        size_t pos = 0;
+
+        RunReader(const string& path, size_t blockSize) : in(path, ios::binary), block(blockSize) {
+            refill();
+        }
+
+        void refill() {
+            in.read(reinterpret_cast<char*>(block.data()), block.size() * sizeof(EdgeRecord));
+            count = (size_t)in.gcount() / sizeof(EdgeRecord);
+            pos = 0;
+        }
+
+        bool done() const {
+            return pos >= count;
+        }
+
+        const EdgeRecord& current() const {
+            return block[pos];
+        }
+
+        void advance() {
+            if (++pos >= count && in) {
+                refill();
+            }
+        }
+    };
+
+    // K-way merge of a group of runs, passing each record in order to `emit`
+    template <typename Emit>
+    void mergeRuns(const vector<string>& group, Emit emit) {
+        size_t blockSize = max<size_t>(1, bufferCapacity / (group.size() + 1));
+        vector<RunReader*> readers;
+        for (const string& path : group) {
+            readers.push_back(new RunReader(path, blockSize));
+        }
+
+        auto later = [&](size_t a, size_t b) { return readers[b]->current() < readers[a]->current(); };
+        priority_queue<size_t, vector<size_t>, decltype(later)> heap(later);
+        for (size_t r = 0; r < readers.size(); ++r) {
+            if (!readers[r]->done()) {
+                heap.push(r);
+            }
+        }
+
+        while (!heap.empty()) {
+            size_t r = heap.top();
+            heap.pop();
+            emit(readers[r]->current());
+            readers[r]->advance();
+            if (!readers[r]->done()) {
+                heap.push(r);
+            }
+        }
+
+        for (RunReader* reader : readers) {
+            delete reader;
+        }
+    }
+
+    static void removeRuns(const vector<string>& group) {
+        for (const string& path : group) {
+            remove(path.c_str());
+        }
+    }
+
+public:
+    static const unsigned long long COMPLETE = ~0ull;   // Checkpoint position once every edge was added
+
+    ExternalGraphBuilder(const string& workDir, size_t memoryBudgetBytes = 64u << 20)
+        : workDir(workDir) {
+        filesystem::create_directories(workDir);   // Fails here, not at the first spill
+        bufferCapacity = max<size_t>(1024, memoryBudgetBytes / sizeof(EdgeRecord));
+        maxFanIn = max<size_t>(2, memoryBudgetBytes / (64u << 10));   // At least 64 KB per open run
+        buffer.reserve(bufferCapacity);
+    }
+
+    void addEdge(unsigned int book1, unsigned int book2, double weight) {
+        buffer.push_back({book1, book2, weight});
+        buffer.push_back({book2, book1, weight});
+        entries += 2;
+        if (buffer.size() + 2 > bufferCapacity) {
+            spill();
+        }
+    }
+
+    unsigned long long entryCount() const {
+        return entries;
+    }
+
+    size_t runCount() const {
+        return runs.size();
+    }
+
+    // Writes out what is still buffered and hands over every run, leaving the files for another builder
+    vector<string> releaseRuns() {
+        spill();
+        vector<string> released;
+        released.swap(runs);
+        entries = 0;
+        return released;
+    }
+
+    // Adds a sorted run written by another builder; it is deleted once merged
+    void adoptRun(const string& path) {
+        error_code ec;
+        unsigned long long bytes = filesystem::file_size(path, ec);
+        if (ec || bytes % sizeof(EdgeRecord) != 0) {
+            throw runtime_error("Particion de aristas invalida: " + path);
+        }
+        entries += bytes / sizeof(EdgeRecord);
+        runs.push_back(path);
+    }
+
+    /*
+     * Turns on checkpoints for the build identified by `buildFingerprint` and picks up the last
+     * checkpoint left in the work directory by the same build. Returns the position saved with
+     * it (the caller continues adding edges from there), COMPLETE if only the merge was left, or
+     * 0 to start over. Run files not listed in the checkpoint are partial output and are deleted.
+     */
+    unsigned long long resume(unsigned long long buildFingerprint) {
+        checkpointing = true;
+        fingerprint = buildFingerprint;
+        buffer.clear();
+        runs.clear();
+        entries = 0;
+        nextRun = 0;
+
+        unsigned long long position = 0;
+        if (!readCheckpoint(position)) {
+            runs.clear();
+            entries = 0;
+            nextRun = 0;
+            position = 0;
+        }
+
+        error_code ec;
+        for (const auto& file : filesystem::directory_iterator(workDir, ec)) {
+            string name = file.path().filename().string();
+            if (name.compare(0, 4, "run_") == 0 && find(runs.begin(), runs.end(), workDir + "/" + name) == runs.end()) {
+                filesystem::remove(file.path(), ec);
+            }
+        }
+        return position;
+    }
+
+    // Makes every edge added so far durable; a restarted build resumes at `position`
+    void checkpoint(unsigned long long position) {
+        if (!checkpointing) {
+            return;
+        }
+        spill();
+        writeCheckpoint(position);
+    }
+
+    // Merges every run and writes the CSR file for a graph of nodeCount nodes
+    void finish(const string& csrPath, unsigned int nodeCount) {
+        spill();
+        checkpoint(COMPLETE);
+        // The merge readers get the whole budget, so the edge buffer must not outlive the spill
+        decltype(buffer)().swap(buffer);
+
+        // Reduce the number of runs until they can be merged in one pass. The inputs of a pass are
+        // only deleted once a checkpoint lists its outputs.
+        while (runs.size() > maxFanIn) {
+            vector<string> next;
+            for (size_t first = 0; first < runs.size(); first += maxFanIn) {
+                vector<string> group(runs.begin() + first, runs.begin() + min(runs.size(), first + maxFanIn));
+                string path = runPath();
+                ofstream out(path, ios::binary);
+                mergeRuns(group, [&](const EdgeRecord& e) {
+                    out.write(reinterpret_cast<const char*>(&e), sizeof(EdgeRecord));
+                });
+                out.close();
+                if (checkpointing) {
+                    syncPath(path);
+                }
+                next.push_back(path);
+            }
+            runs.swap(next);
+            checkpoint(COMPLETE);
+            removeRuns(next);
+        }
+
+        // Final pass: targets go to the CSR file, weights to a side file appended at the end
+        unsigned long long n = nodeCount, m = entries;
+        vector<unsigned long long, PolicyAllocator<unsigned long long, HugePageAllocation>> offsets(nodeCount + 1, 0);
+        string partialPath = csrPath + ".tmp";
+        ofstream out(partialPath, ios::binary);
+        string weightsPath = csrPath + ".weights";
+        ofstream weights(weightsPath, ios::binary);
+        out.write(CSR_MAGIC, sizeof(CSR_MAGIC));
+        out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        out.write(reinterpret_cast<const char*>(&m), sizeof(m));
+        streampos offsetsPos = out.tellp();
+        out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(unsigned long long));
+
+        unsigned long long written = 0;
+        mergeRuns(runs, [&](const EdgeRecord& e) {
+            ++offsets[e.source + 1];
+            out.write(reinterpret_cast<const char*>(&e.target), sizeof(e.target));
+            weights.write(reinterpret_cast<const char*>(&e.weight), sizeof(e.weight));
+            ++written;
+        });
+
+        if ((written * sizeof(unsigned int)) % 8 != 0) {
+            unsigned int padding = 0;
+            out.write(reinterpret_cast<const char*>(&padding), sizeof(padding));
+        }
+        weights.close();
+        if (written > 0) {
+            ifstream weightsIn(weightsPath, ios::binary);
+            out << weightsIn.rdbuf();
+        }
+        remove(weightsPath.c_str());
+
+        for (unsigned int i = 0; i < nodeCount; ++i) {
+            offsets[i + 1] += offsets[i];
+        }
+        out.seekp(offsetsPos);
+        out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(unsigned long long));
+        out.close();
+        if (!out) {
+            throw runtime_error("No se pudo escribir el grafo " + csrPath);
+        }
+
+        // The graph only appears under its name once complete; after that the checkpoint is stale
+        if (checkpointing) {
+            syncPath(partialPath);
+        }
+        if (rename(partialPath.c_str(), csrPath.c_str()) != 0) {
+            throw runtime_error("No se pudo escribir el grafo " + csrPath);
+        }
+        if (checkpointing) {
+            remove(checkpointPath().c_str());
+            syncPath(workDir);
+        }
+        removeRuns(runs);
+        runs.clear();
+    }
+};
+
+/*
+ * Read-only view of a CSR graph file, mapped in memory.
+ */
+class MappedCsrGraph {
+    const unsigned char* base = nullptr;
+    size_t length = 0;
+    unsigned long long nodes = 0;
+    unsigned long long entries = 0;
+    const unsigned long long* offsets = nullptr;
+    const unsigned int* targets = nullptr;
+    const double* weights = nullptr;
+
+    void unmap() {
+#if defined(__linux__)
+        if (base) {
+            munmap(const_cast<unsigned char*>(base), length);
+            base = nullptr;
+        }
+#endif
+    }
+
+    // Checks the header against the file length and the offsets against the edge count before
+    // publishing the section pointers; the targets are left unread so the mapping stays lazy
+    void validate(const string& path) {
+        if (memcmp(base, CSR_MAGIC, sizeof(CSR_MAGIC)) != 0) {
+            throw runtime_error("Formato de grafo invalido: " + path);
+        }
+        memcpy(&nodes, base + 8, sizeof(nodes));
+        memcpy(&entries, base + 16, sizeof(entries));
+        unsigned long long available = length - 24;
+        if (nodes >= available / sizeof(unsigned long long) || nodes > (unsigned long long)INT_MAX) {
+            throw runtime_error("Grafo truncado o corrupto: " + path);
+        }
+        available -= (nodes + 1) * sizeof(unsigned long long);
+        // Each entry takes a target and a weight, the targets padded to 8 bytes
+        if (entries > available / (sizeof(unsigned int) + sizeof(double))) {
+            throw runtime_error("Grafo truncado o corrupto: " + path);
+        }
+        unsigned long long targetBytes = (entries * sizeof(unsigned int) + 7) / 8 * 8;
+        if (targetBytes + entries * sizeof(double) != available) {
+            throw runtime_error("Grafo truncado o corrupto: " + path);
+        }
+        offsets = reinterpret_cast<const unsigned long long*>(base + 24);
+        if (offsets[0] != 0 || offsets[nodes] != entries) {
+            throw runtime_error("Grafo truncado o corrupto: " + path);
+        }
+        for (unsigned long long i = 0; i < nodes; ++i) {
+            if (offsets[i] > offsets[i + 1]) {
+                throw runtime_error("Grafo truncado o corrupto: " + path);
+            }
+        }
+        targets = reinterpret_cast<const unsigned int*>(offsets + nodes + 1);
+        weights = reinterpret_cast<const double*>(reinterpret_cast<const unsigned char*>(targets) + targetBytes);
+    }
+
+public:
+    explicit MappedCsrGraph(const string& path) {
+#if defined(__linux__)
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("No se pudo abrir el grafo " + path);
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw runtime_error("No se pudo leer el tamano del grafo " + path);
+        }
+        length = (size_t)info.st_size;
+        if (length < 24) {
+            close(fd);
+            throw runtime_error("Formato de grafo invalido: " + path);
+        }
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            throw runtime_error("No se pudo mapear el grafo " + path);
+        }
+        base = static_cast<const unsigned char*>(p);
+#if defined(MADV_HUGEPAGE)
+        // Only honored where the kernel can back file pages with huge pages; otherwise a no-op
+        madvise(p, length, MADV_HUGEPAGE);
+#endif
+#else
+        throw runtime_error("MappedCsrGraph requiere mmap");
+#endif
+        try {
+            validate(path);
+        } catch (...) {
+            unmap();
+            throw;
+        }
+    }
+
+    ~MappedCsrGraph() {
+        unmap();
+    }
+
+    MappedCsrGraph(const MappedCsrGraph&) = delete;
+    MappedCsrGraph& operator=(const MappedCsrGraph&) = delete;
+
+    int size() const {
+        return (int)nodes;
+    }
+
+    size_t edgeCount() const {
+        return (size_t)(entries / 2);
+    }
+
+    // Returns (neighbor index, weight) pairs in ascending index order
+    vector<pair<int, double>> neighbors(int book) const {
+        vector<pair<int, double>> result;
+        for (unsigned long long e = offsets[book]; e < offsets[book + 1]; ++e) {
+            result.emplace_back((int)targets[e], weights[e]);
+        }
+        return result;
+    }
+};
+
+#endif
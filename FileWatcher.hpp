@@ -0,0 +1,109 @@
+#ifndef FILE_WATCHER_HPP
+#define FILE_WATCHER_HPP
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <filesystem>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/*
+ * Calls onChange on a background thread after a file is modified, appended to, or replaced by a
+ * rename. On Linux it watches the file's directory with inotify, so replacing the file also
+ * counts. Bursts of events are coalesced: the callback runs once the file has been quiet for
+ * `settle`. Elsewhere, or if inotify is not available, the modification time is polled.
+ */
+class FileWatcher {
+    string directory;
+    string name;
+    function<void()> onChange;
+    chrono::milliseconds settle;
+    atomic<bool> stopping{false};
+    bool inotify = false;
+    thread worker;
+
+#if defined(__linux__)
+    void watchInotify(int fd) {
+        char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        bool pending = false;
+        auto lastEvent = chrono::steady_clock::now();
+
+        while (!stopping.load()) {
+            struct pollfd waiting = {fd, POLLIN, 0};
+            if (poll(&waiting, 1, 50) > 0 && (waiting.revents & POLLIN)) {
+                ssize_t length = read(fd, buffer, sizeof(buffer));
+                for (ssize_t pos = 0; pos < length;) {
+                    const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer + pos);
+                    if (event->len > 0 && name == event->name) {
+                        pending = true;
+                        lastEvent = chrono::steady_clock::now();
+                    }
+                    pos += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            if (pending && chrono::steady_clock::now() - lastEvent >= settle) {
+                pending = false;
+                onChange();
+            }
+        }
+        close(fd);
+    }
+#endif
+
+    void watchPolling(const string& path) {
+        error_code ec;
+        auto seen = filesystem::last_write_time(path, ec);
+        while (!stopping.load()) {
+            this_thread::sleep_for(chrono::milliseconds(500));
+            auto now = filesystem::last_write_time(path, ec);
+            if (!ec && now != seen) {
+                seen = now;
+                onChange();
+            }
+        }
+    }
+
+public:
+    FileWatcher(const string& path, function<void()> onChange, chrono::milliseconds settle = chrono::milliseconds(100))
+        : onChange(std::move(onChange)), settle(settle) {
+        filesystem::path file(path);
+        directory = file.has_parent_path() ? file.parent_path().string() : ".";
+        name = file.filename().string();
+
+#if defined(__linux__)
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd >= 0 && inotify_add_watch(fd, directory.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) >= 0) {
+            inotify = true;
+            worker = thread(&FileWatcher::watchInotify, this, fd);
+            return;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+        worker = thread(&FileWatcher::watchPolling, this, path);
+    }
+
+    ~FileWatcher() {
+        stopping.store(true);
+        worker.join();
+    }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    bool usingInotify() const {
+        return inotify;
+    }
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef GRAPH_REORDERING_HPP
+#define GRAPH_REORDERING_HPP
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <utility>
+#include "WeightedUndirectedGraph.hpp"
+
+using namespace std;
+
+/*
+ * Node reordering for the similarity graph.
+ *
+ * Book indexes come from the CSV row order, so the neighbors of a book are scattered in memory.
+ * Each ordering below returns a permutation `order` where order[newIndex] = oldIndex. The books
+ * are permuted with permuteBooks and the graph is rebuilt from a RelabeledGraph, so every
+ * book-indexed structure (title AVL values, CSR arrays, compressed lists) must be built after
+ * the permutation is applied. Libro::id keeps the original id of the CSV.
+ */
+
+// Highest degree first, ties by original index
+template <typename Source>
+vector<int> degreeOrder(const Source& graph) {
+    int n = graph.size();
+    vector<size_t> degree(n);
+    for (int i = 0; i < n; ++i) {
+        degree[i] = graph.neighbors(i).size();
+    }
+
+    vector<int> order(n);
+    for (int i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return degree[a] > degree[b]; });
+    return order;
+}
+
+// Reverse Cuthill-McKee: BFS from a minimum degree node of each component, visiting neighbors by increasing degree
+template <typename Source>
+vector<int> reverseCuthillMcKee(const Source& graph) {
+    int n = graph.size();
+    vector<size_t> degree(n);
+    for (int i = 0; i < n; ++i) {
+        degree[i] = graph.neighbors(i).size();
+    }
+
+    vector<int> byDegree(n);
+    for (int i = 0; i < n; ++i) {
+        byDegree[i] = i;
+    }
+    stable_sort(byDegree.begin(), byDegree.end(), [&](int a, int b) { return degree[a] < degree[b]; });
+
+    vector<int> order;
+    order.reserve(n);
+    vector<bool> visited(n, false);
+    vector<int> next;
+    for (int start : byDegree) {
+        if (visited[start]) {
+            continue;
+        }
+        visited[start] = true;
+        order.push_back(start);
+
+        for (size_t head = order.size() - 1; head < order.size(); ++head) {
+            next.clear();
+            for (const auto& neighbor : graph.neighbors(order[head])) {
+                if (!visited[neighbor.first]) {
+                    visited[neighbor.first] = true;
+                    next.push_back(neighbor.first);
+                }
+            }
+            stable_sort(next.begin(), next.end(), [&](int a, int b) { return degree[a] < degree[b]; });
+            order.insert(order.end(), next.begin(), next.end());
+        }
+    }
+
+    reverse(order.begin(), order.end());
+    return order;
+}
+
+// Books clustered by (genre, author, publication date), ties by original index
+template <typename Container>
+vector<int> attributeOrder(const Container& libros) {
+    int n = (int)libros.size();
+    vector<int> order(n);
+    for (int i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        const Libro& x = libros[a];
+        const Libro& y = libros[b];
+        if (x.genre != y.genre) return x.genre < y.genre;
+        if (x.author != y.author) return x.author < y.author;
+        return x.publication_date < y.publication_date;
+    });
+    return order;
+}
+
+// Returns position[oldIndex] = newIndex
+inline vector<int> inversePermutation(const vector<int>& order) {
+    vector<int> position(order.size());
+    for (size_t k = 0; k < order.size(); ++k) {
+        position[order[k]] = (int)k;
+    }
+    return position;
+}
+
+// Permutes any indexable array in place so that element k becomes the old element order[k]
+template <typename Container>
+void permuteBooks(Container& libros, const vector<int>& order) {
+    vector<bool> placed(order.size(), false);
+    for (size_t start = 0; start < order.size(); ++start) {
+        if (placed[start]) {
+            continue;
+        }
+        // Follow the cycle that starts at this position
+        size_t k = start;
+        while (!placed[k]) {
+            placed[k] = true;
+            size_t from = (size_t)order[k];
+            if (from != start) {
+                swap(libros[(unsigned int)k], libros[(unsigned int)from]);
+            }
+            k = from;
+        }
+    }
+}
+
+// View of a graph with its nodes renumbered by a permutation, with neighbors in ascending new index order
+template <typename Source>
+class RelabeledGraph {
+    const Source& graph;
+    vector<int> order;      // newIndex -> oldIndex
+    vector<int> position;   // oldIndex -> newIndex
+
+public:
+    RelabeledGraph(const Source& graph, const vector<int>& order)
+        : graph(graph), order(order), position(inversePermutation(order)) {}
+
+    int size() const {
+        return (int)order.size();
+    }
+
+    vector<pair<int, double>> neighbors(int book) const {
+        vector<pair<int, double>> result = graph.neighbors(order[book]);
+        for (auto& neighbor : result) {
+            neighbor.first = position[neighbor.first];
+        }
+        sort(result.begin(), result.end());
+        return result;
+    }
+};
+
+#endif
@@ -0,0 +1,406 @@
+#ifndef HOT_CATALOG_HPP
+#define HOT_CATALOG_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <set>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include "SegmentedDynamicArray_SR.hpp"
+#include "KeyValueAVLTree.hpp"
+#include "CatalogReader.hpp"
+#include "BucketSimilarityGraph.hpp"
+
+using namespace std;
+
+/*
+ * One complete version of the catalog: the books, every index built from them and the rows of
+ * the CSV they came from. Readers only ever see a generation through a pointer to const, and a
+ * generation is only modified while no reader holds it (see HotCatalog).
+ */
+struct CatalogGeneration {
+    unsigned long long number = 0;
+    string source;
+    SegmentedDynamicArray<Libro> books;
+    KeyValueAVLTree<string, int> titles;                            // Title -> lowest book index with it
+    unordered_map<string, set<int>> titleBooks;                     // Title -> every book index with it
+    KeyValueAVLTree<string, unordered_map<int, Libro>> genres;      // Genre -> books of the genre
+    BucketSimilarityGraph graph;
+    vector<CatalogRow> rows;                                        // One per line of the CSV
+    unsigned long long scannedBytes = 0;                            // End of the last complete line
+    unsigned long long invalidRows = 0;
+    double buildSeconds = 0;
+};
+
+// Rows of the CSV that differ from the ones a generation was built from
+struct CatalogDelta {
+    vector<pair<size_t, string>> changed;                       // Row number, new line
+    vector<pair<unsigned long long, string>> appended;          // Offset, line
+    bool rowsRemoved = false;
+    unsigned long long scannedBytes = 0;
+
+    bool empty() const {
+        return changed.empty() && appended.empty() && !rowsRemoved;
+    }
+};
+
+namespace hot_detail {
+
+inline void addToGenre(CatalogGeneration& generation, int index) {
+    const Libro& libro = generation.books[index];
+    KeyValueAVLNode<string, unordered_map<int, Libro>>* node = generation.genres.find(libro.genre);
+    if (node) {
+        node->value[index] = libro;
+    } else {
+        unordered_map<int, Libro> books;
+        books[index] = libro;
+        generation.genres.insert(libro.genre, books);
+    }
+}
+
+// The title entry always names the first book in CSV order with the title, as a full build does
+inline void addTitle(CatalogGeneration& generation, int index) {
+    const string& title = generation.books[index].title;
+    set<int>& books = generation.titleBooks[title];
+    books.insert(index);
+    KeyValueAVLNode<string, int>* node = generation.titles.find(title);
+    if (node) {
+        node->value = *books.begin();
+    } else {
+        generation.titles.insert(title, index);
+    }
+}
+
+// Re-points the title entry to another book with the same title, or drops it if there is none
+inline void removeTitle(CatalogGeneration& generation, int index) {
+    const string title = generation.books[index].title;
+    auto books = generation.titleBooks.find(title);
+    if (books == generation.titleBooks.end()) {
+        return;
+    }
+    books->second.erase(index);
+    if (books->second.empty()) {
+        generation.titleBooks.erase(books);
+        generation.titles.erase(title);
+    } else {
+        generation.titles.find(title)->value = *books->second.begin();
+    }
+}
+
+inline void removeFromGenre(CatalogGeneration& generation, int index) {
+    const string genre = generation.books[index].genre;
+    KeyValueAVLNode<string, unordered_map<int, Libro>>* node = generation.genres.find(genre);
+    if (node) {
+        node->value.erase(index);
+        if (node->value.empty()) {
+            generation.genres.erase(genre);
+        }
+    }
+}
+
+// Appends one line as a new row, and as a new book if it parses
+inline void appendRow(CatalogGeneration& generation, unsigned long long offset, const string& line) {
+    CatalogRow row{offset, rowChecksum(line), -1};
+    if (!line.empty()) {
+        try {
+            Libro libro = parseLibro(line);
+            row.book = (int)generation.books.size();
+            generation.books.push_back(libro);
+            addTitle(generation, row.book);
+            addToGenre(generation, row.book);
+            generation.graph.addBook(libro);
+        } catch (const exception&) {
+            ++generation.invalidRows;     // A row being rewritten while we read it
+        }
+    }
+    generation.rows.push_back(row);
+}
+
+} // namespace hot_detail
+
+// Builds a full generation from the complete lines of a CSV
+inline unique_ptr<CatalogGeneration> buildGeneration(const string& csvPath, unsigned long long number,
+                                                     const vector<pair<unsigned long long, string>>& lines,
+                                                     unsigned long long scannedBytes) {
+    auto start = chrono::steady_clock::now();
+    unique_ptr<CatalogGeneration> generation(new CatalogGeneration());
+    generation->number = number;
+    generation->source = csvPath;
+    generation->rows.reserve(lines.size());
+    for (const auto& line : lines) {
+        hot_detail::appendRow(*generation, line.first, line.second);
+    }
+    generation->scannedBytes = scannedBytes;
+    generation->buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return generation;
+}
+
+inline unique_ptr<CatalogGeneration> buildGeneration(const string& csvPath, unsigned long long number) {
+    vector<pair<unsigned long long, string>> lines;
+    long long end = readCompleteLines(csvPath, 0, lines);
+    if (end < 0) {
+        throw runtime_error("Error al abrir el archivo " + csvPath);
+    }
+    return buildGeneration(csvPath, number, lines, (unsigned long long)end);
+}
+
+/*
+ * Compares the CSV with the rows of a generation by row number and checksum. Lines are hashed
+ * in place, only the changed and appended ones are copied out.
+ */
+inline CatalogDelta diffCatalog(const CatalogGeneration& generation, const string& csvPath) {
+    ifstream file(csvPath, ios::binary);
+    if (!file) {
+        throw runtime_error("Error al abrir el archivo " + csvPath);
+    }
+    string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    CatalogDelta delta;
+    size_t row = 0;
+    size_t start = 0;
+    size_t newline;
+    while ((newline = contents.find('\n', start)) != string::npos) {
+        size_t length = newline - start;
+        if (length > 0 && contents[newline - 1] == '\r') {
+            --length;
+        }
+        if (row < generation.rows.size()) {
+            if (rowChecksum(contents.data() + start, length) != generation.rows[row].checksum) {
+                delta.changed.emplace_back(row, contents.substr(start, length));
+            }
+        } else {
+            delta.appended.emplace_back(start, contents.substr(start, length));
+        }
+        ++row;
+        start = newline + 1;
+    }
+    delta.scannedBytes = start;
+    delta.rowsRemoved = row < generation.rows.size();
+    return delta;
+}
+
+/*
+ * True if the delta can be applied in place: no rows were removed and every changed row was a
+ * valid book and still is one, so that book indexes stay dense and in CSV order.
+ */
+inline bool canApplyIncrementally(const CatalogGeneration& generation, const CatalogDelta& delta) {
+    if (delta.rowsRemoved) {
+        return false;
+    }
+    for (const auto& change : delta.changed) {
+        if (generation.rows[change.first].book < 0 || change.second.empty()) {
+            return false;
+        }
+        try {
+            parseLibro(change.second);
+        } catch (const exception&) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Applies a delta accepted by canApplyIncrementally to every structure of the generation
+inline void applyDelta(CatalogGeneration& generation, const CatalogDelta& delta) {
+    for (const auto& change : delta.changed) {
+        CatalogRow& row = generation.rows[change.first];
+        int index = row.book;
+        Libro libro = parseLibro(change.second);
+        Libro& current = generation.books[index];
+
+        bool retitled = current.title != libro.title;
+        if (retitled) {
+            hot_detail::removeTitle(generation, index);
+        }
+        hot_detail::removeFromGenre(generation, index);
+        generation.graph.updateBook(index, libro);
+        current = libro;
+        if (retitled) {
+            hot_detail::addTitle(generation, index);
+        }
+        hot_detail::addToGenre(generation, index);
+        row.checksum = rowChecksum(change.second);
+    }
+
+    for (const auto& line : delta.appended) {
+        hot_detail::appendRow(generation, line.first, line.second);
+    }
+    generation.scannedBytes = delta.scannedBytes;
+}
+
+/*
+ * Double-buffered catalog. Readers take the published generation with current() and keep the
+ * shared_ptr for the whole query; they never wait.
+ *
+ * Two copies of the catalog are kept (left-right): the published one and a standby one. When
+ * the CSV changes, refresh() finds the changed and appended rows, waits until no query still
+ * holds the standby copy, applies the delta there and publishes it with an atomic store. The
+ * copy that was published becomes the standby and receives the same delta on the next refresh,
+ * so each update costs the size of the delta, not a rebuild. Deltas that remove rows or make a
+ * book invalid go through reload(), which builds both copies from scratch in the background.
+ */
+class HotCatalog {
+    shared_ptr<const CatalogGeneration> published;     // Only accessed through atomic_load/atomic_store
+    shared_ptr<CatalogGeneration> active;              // Same generation as `published`, writable
+    shared_ptr<CatalogGeneration> standby;
+    CatalogDelta lagging;                              // Applied to `active` but not yet to `standby`
+    string source;
+    mutex writeLock;                                   // Serializes refresh() and the reload builds
+    thread builder;
+    atomic<bool> building{false};
+    unsigned long long nextNumber = 1;
+    shared_ptr<atomic<int>> live = make_shared<atomic<int>>(0);    // Generations not freed yet
+    mutex eventLock;
+    vector<string> pendingEvents;
+
+    // Wraps a generation so that freeing it is counted
+    shared_ptr<CatalogGeneration> adopt(unique_ptr<CatalogGeneration> generation) {
+        shared_ptr<atomic<int>> counter = live;
+        ++*counter;
+        return shared_ptr<CatalogGeneration>(generation.release(), [counter](CatalogGeneration* g) {
+            delete g;
+            --*counter;
+        });
+    }
+
+    void report(const string& event) {
+        lock_guard<mutex> guard(eventLock);
+        pendingEvents.push_back(event);
+    }
+
+    // Builds both copies from the current file and publishes one; the caller holds writeLock
+    void rebuildLocked() {
+        vector<pair<unsigned long long, string>> lines;
+        long long end = readCompleteLines(source, 0, lines);
+        if (end < 0) {
+            throw runtime_error("Error al abrir el archivo " + source);
+        }
+        unsigned long long number = nextNumber++;
+        shared_ptr<CatalogGeneration> fresh = adopt(buildGeneration(source, number, lines, end));
+        standby = adopt(buildGeneration(source, number, lines, end));
+        lagging = CatalogDelta();
+        active = fresh;
+        atomic_store(&published, shared_ptr<const CatalogGeneration>(active));
+    }
+
+public:
+    // Builds the first generation before returning
+    explicit HotCatalog(const string& csvPath) : source(csvPath) {
+        lock_guard<mutex> guard(writeLock);
+        rebuildLocked();
+    }
+
+    ~HotCatalog() {
+        if (builder.joinable()) {
+            builder.join();
+        }
+    }
+
+    HotCatalog(const HotCatalog&) = delete;
+    HotCatalog& operator=(const HotCatalog&) = delete;
+
+    shared_ptr<const CatalogGeneration> current() const {
+        return atomic_load(&published);
+    }
+
+    /*
+     * Starts rebuilding both copies from the source CSV on a background thread. Returns false if
+     * a reload is already running. If the build fails the current generation stays published and
+     * the error is reported through events().
+     */
+    bool reload() {
+        bool expected = false;
+        if (!building.compare_exchange_strong(expected, true)) {
+            return false;
+        }
+        if (builder.joinable()) {
+            builder.join();
+        }
+        builder = thread([this]() {
+            try {
+                lock_guard<mutex> guard(writeLock);
+                rebuildLocked();
+            } catch (const exception& e) {
+                report(string("La recarga fallo, se sigue usando la generacion anterior: ") + e.what());
+            }
+            building.store(false);
+        });
+        return true;
+    }
+
+    /*
+     * Brings the catalog up to date with the CSV. Appended and changed rows are applied
+     * incrementally; anything else falls back to a full rebuild. Runs on the caller's thread,
+     * which is the file watcher's in the interactive mode.
+     */
+    void refresh() {
+        try {
+            lock_guard<mutex> guard(writeLock);
+            auto start = chrono::steady_clock::now();
+            CatalogDelta delta = diffCatalog(*active, source);
+            if (delta.empty()) {
+                return;
+            }
+            if (!canApplyIncrementally(*active, delta)) {
+                rebuildLocked();
+                report("Filas eliminadas o invalidas: catalogo reconstruido por completo");
+                return;
+            }
+
+            // Wait for the queries that still use the standby copy, nobody else can reach it
+            while (standby.use_count() > 1) {
+                this_thread::yield();
+            }
+            atomic_thread_fence(memory_order_acquire);
+
+            applyDelta(*standby, lagging);
+            applyDelta(*standby, delta);
+            standby->number = nextNumber++;
+            standby->buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            swap(active, standby);
+            atomic_store(&published, shared_ptr<const CatalogGeneration>(active));
+            lagging = std::move(delta);
+            report("Actualizacion incremental: " + to_string(lagging.appended.size()) + " filas nuevas, "
+                   + to_string(lagging.changed.size()) + " modificadas");
+        } catch (const exception& e) {
+            report(string("La actualizacion fallo, se sigue usando la generacion anterior: ") + e.what());
+        }
+    }
+
+    bool reloading() const {
+        return building.load();
+    }
+
+    // Blocks until the running reload, if any, has been published
+    void waitReload() {
+        while (building.load()) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+
+    // Messages about updates and failures since the last call
+    vector<string> events() {
+        lock_guard<mutex> guard(eventLock);
+        vector<string> result;
+        result.swap(pendingEvents);
+        return result;
+    }
+
+    // Published and standby copies plus the old generations still held by queries
+    int liveGenerations() const {
+        return live->load();
+    }
+
+    const string& path() const {
+        return source;
+    }
+};
+
+#endif
@@ -0,0 +1,238 @@
+//=================================================================================================================
+/**
+ *  Allocation policies for the raw storage of the array containers.
+ */
+ //=================================================================================================================
+
+#ifndef HUGE_PAGE_ALLOCATION_HPP
+#define HUGE_PAGE_ALLOCATION_HPP
+
+// Includes
+#include <cstddef>      // For size_t
+#include <cstdlib>      // For std::malloc, std::realloc, std::free
+#include <cstring>      // For std::memcpy
+#include <new>          // For std::bad_alloc
+
+#if defined(__linux__)
+#include <sys/mman.h>   // For mmap, munmap, madvise
+#endif
+
+/**
+ *  Allocation policy that uses the regular heap.
+ */
+struct HeapAllocation {
+
+    /**
+     *  Allocates a block of memory.
+     *
+     *  @param[in]  bytes   The size of the block.
+     *
+     *  @return Pointer to the block.
+     */
+    static void* allocate(size_t bytes)
+    {
+        void* p = std::malloc(bytes);
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    /**
+     *  Changes the size of a block, keeping its contents.
+     *
+     *  @param[in]  p           Pointer to the block, may be nullptr.
+     *  @param[in]  oldBytes    The current size of the block.
+     *  @param[in]  newBytes    The new size of the block.
+     *
+     *  @return Pointer to the resized block.
+     */
+    static void* reallocate(void* p, size_t oldBytes, size_t newBytes)
+    {
+        (void)oldBytes;
+        void* q = std::realloc(p, newBytes);
+        if (q == nullptr)
+            throw std::bad_alloc();
+        return q;
+    }
+
+    /**
+     *  Releases a block of memory.
+     *
+     *  @param[in]  p       Pointer to the block, may be nullptr.
+     *  @param[in]  bytes   The size of the block.
+     */
+    static void deallocate(void* p, size_t bytes)
+    {
+        (void)bytes;
+        std::free(p);
+    }
+};
+
+/**
+ *  Allocation policy that backs large blocks with 2 MB pages to reduce TLB misses.
+ *
+ *  Blocks of at least one huge page are mapped with MAP_HUGETLB. If the system has no huge
+ *  pages reserved, the block is mapped normally and marked with MADV_HUGEPAGE so that
+ *  transparent huge pages can back it. Smaller blocks, and every block on systems without
+ *  these facilities, come from the regular heap. The path is chosen from the size alone, so
+ *  deallocate() needs no header in the block.
+ *
+ *  Whether it helps depends on the working set exceeding TLB reach and on the kernel granting
+ *  the pages; `--medir-paginas-grandes` compares both policies on the title tree and the CSR.
+ */
+struct HugePageAllocation {
+
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;   /**< Size of a huge page. */
+
+    /**
+     *  Allocates a block of memory.
+     *
+     *  @param[in]  bytes   The size of the block.
+     *
+     *  @return Pointer to the block.
+     */
+    static void* allocate(size_t bytes)
+    {
+#if defined(__linux__)
+        if (uses_pages(bytes)) {
+            size_t length = round_up(bytes);
+
+#if defined(MAP_HUGETLB)
+            void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED)
+                return p;
+#endif
+
+            // No reserved huge pages: fall back to transparent huge pages
+            void* q = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (q == MAP_FAILED)
+                throw std::bad_alloc();
+#if defined(MADV_HUGEPAGE)
+            madvise(q, length, MADV_HUGEPAGE);
+#endif
+            return q;
+        }
+#endif
+        return HeapAllocation::allocate(bytes);
+    }
+
+    /**
+     *  Changes the size of a block, keeping its contents.
+     *
+     *  @param[in]  p           Pointer to the block, may be nullptr.
+     *  @param[in]  oldBytes    The current size of the block.
+     *  @param[in]  newBytes    The new size of the block.
+     *
+     *  @return Pointer to the resized block.
+     */
+    static void* reallocate(void* p, size_t oldBytes, size_t newBytes)
+    {
+        if (p == nullptr)
+            return allocate(newBytes);
+
+        if (!uses_pages(oldBytes) && !uses_pages(newBytes))
+            return HeapAllocation::reallocate(p, oldBytes, newBytes);
+
+        if (uses_pages(oldBytes) && round_up(oldBytes) == round_up(newBytes))
+            return p;   // The mapping already covers the new size
+
+        void* q = allocate(newBytes);
+        std::memcpy(q, p, oldBytes < newBytes ? oldBytes : newBytes);
+        deallocate(p, oldBytes);
+        return q;
+    }
+
+    /**
+     *  Releases a block of memory.
+     *
+     *  @param[in]  p       Pointer to the block, may be nullptr.
+     *  @param[in]  bytes   The size of the block, as passed to allocate().
+     */
+    static void deallocate(void* p, size_t bytes)
+    {
+        if (p == nullptr)
+            return;
+
+#if defined(__linux__)
+        if (uses_pages(bytes)) {
+            munmap(p, round_up(bytes));
+            return;
+        }
+#endif
+        HeapAllocation::deallocate(p, bytes);
+    }
+
+private:
+
+    /**
+     *  Checks if a block of the given size is mapped with huge pages.
+     */
+    static bool uses_pages(size_t bytes)
+    {
+#if defined(__linux__)
+        return bytes >= HUGE_PAGE_SIZE;
+#else
+        (void)bytes;
+        return false;
+#endif
+    }
+
+    /**
+     *  Rounds a size up to a whole number of huge pages.
+     */
+    static size_t round_up(size_t bytes)
+    {
+        return (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    }
+};
+
+/**
+ *  Standard allocator that takes its memory from an allocation policy, so that containers such
+ *  as std::vector can be backed by huge pages.
+ *
+ *  @tparam T           The type of the elements.
+ *  @tparam Allocation  Allocation policy, HeapAllocation or HugePageAllocation.
+ */
+template <typename T, typename Allocation>
+struct PolicyAllocator {
+
+    using value_type = T;
+
+    PolicyAllocator() = default;
+
+    template <typename U>
+    PolicyAllocator(const PolicyAllocator<U, Allocation>&) {}
+
+    template <typename U>
+    struct rebind {
+        using other = PolicyAllocator<U, Allocation>;
+    };
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(Allocation::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        Allocation::deallocate(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PolicyAllocator<U, Allocation>&) const
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const PolicyAllocator<U, Allocation>&) const
+    {
+        return false;
+    }
+};
+
+#endif
+//=================================================================================================================
+//  END OF FILE
+//=================================================================================================================
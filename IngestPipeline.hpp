@@ -0,0 +1,417 @@
+#ifndef INGEST_PIPELINE_HPP
+#define INGEST_PIPELINE_HPP
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <queue>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include "SegmentedDynamicArray_SR.hpp"
+#include "CatalogReader.hpp"
+
+using namespace std;
+
+/*
+ * Bounded multi-producer multi-consumer lock-free queue (Vyukov's ring of sequenced cells).
+ * push() and pop() spin with yield while the queue is full or empty. When every producer has
+ * called producerDone(), pop() returns false once the queue is drained.
+ */
+template <typename T>
+class BoundedQueue {
+    struct Cell {
+        atomic<size_t> sequence;
+        T data;
+    };
+
+    unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) atomic<size_t> enqueuePos{0};
+    alignas(64) atomic<size_t> dequeuePos{0};
+    atomic<int> producers;
+    atomic<size_t> maxDepth{0};
+    atomic<unsigned long long> depthSum{0};
+    atomic<unsigned long long> pushes{0};
+
+    bool tryPush(T& value) {
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(memory_order_acquire);
+            long long difference = (long long)sequence - (long long)pos;
+            if (difference == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;   // Full
+            } else {
+                pos = enqueuePos.load(memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& value) {
+        size_t pos = dequeuePos.load(memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(memory_order_acquire);
+            long long difference = (long long)sequence - (long long)(pos + 1);
+            if (difference == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;   // Empty
+            } else {
+                pos = dequeuePos.load(memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->data);
+        cell->sequence.store(pos + mask + 1, memory_order_release);
+        return true;
+    }
+
+public:
+    // The capacity is rounded up to a power of two
+    BoundedQueue(size_t capacity, int producers) : producers(producers) {
+        size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) {
+            cells[i].sequence.store(i, memory_order_relaxed);
+        }
+        mask = size - 1;
+    }
+
+    // Returns the time spent waiting for room, in nanoseconds
+    long long push(T value) {
+        auto start = chrono::steady_clock::now();
+        bool waited = false;
+        while (!tryPush(value)) {
+            waited = true;
+            this_thread::yield();
+        }
+
+        size_t current = depth();
+        depthSum += current;
+        ++pushes;
+        size_t seen = maxDepth.load(memory_order_relaxed);
+        while (current > seen && !maxDepth.compare_exchange_weak(seen, current, memory_order_relaxed)) {
+        }
+
+        return waited ? chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() : 0;
+    }
+
+    // Returns false when the queue is empty and closed. waitNs accumulates the time spent waiting.
+    bool pop(T& value, long long& waitNs) {
+        auto start = chrono::steady_clock::now();
+        bool waited = false;
+        while (!tryPop(value)) {
+            if (producers.load(memory_order_acquire) == 0) {
+                // Every push happened before the last producerDone, so one more try is conclusive
+                if (tryPop(value)) {
+                    break;
+                }
+                waitNs += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+                return false;
+            }
+            waited = true;
+            this_thread::yield();
+        }
+        if (waited) {
+            waitNs += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        }
+        return true;
+    }
+
+    void producerDone() {
+        producers.fetch_sub(1, memory_order_acq_rel);
+    }
+
+    size_t depth() const {
+        size_t enqueued = enqueuePos.load(memory_order_relaxed);
+        size_t dequeued = dequeuePos.load(memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    size_t maximumDepth() const {
+        return maxDepth.load();
+    }
+
+    double averageDepth() const {
+        unsigned long long n = pushes.load();
+        return n == 0 ? 0.0 : (double)depthSum.load() / n;
+    }
+};
+
+// Assigns a dense id to every distinct string
+class StringInterner {
+    unordered_map<string, unsigned int> ids;
+    vector<string> names;
+
+public:
+    unsigned int intern(const string& value) {
+        auto it = ids.find(value);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        unsigned int id = (unsigned int)names.size();
+        ids.emplace(value, id);
+        names.push_back(value);
+        return id;
+    }
+
+    const string& name(unsigned int id) const {
+        return names[id];
+    }
+
+    size_t size() const {
+        return names.size();
+    }
+};
+
+/*
+ * Staged ingest of the catalog:
+ *
+ *   reader thread -> parser workers -> interning stage -> index builders (one thread each)
+ *
+ * connected by bounded lock-free queues so that the stages overlap. The interning stage puts the
+ * books back in CSV order, appends them to the book store and interns their genre. Index
+ * builders receive the index of every new book with its genre id and read the book from the
+ * store, which supports reads concurrent with appends; a builder grouping by genre can keep a
+ * slot per id instead of looking the genre string up for every book. Each stage records its
+ * items, busy time and the time spent waiting on its queues.
+ */
+struct IngestedBook {
+    unsigned int index;     // Position in the book store
+    unsigned int genre;     // Dense id, 0 for the first genre seen
+};
+
+class IngestPipeline {
+    struct Line {
+        unsigned int row;
+        string text;
+    };
+
+    struct Parsed {
+        unsigned int row;
+        bool ok;
+        Libro libro;
+    };
+
+    struct StageMetrics {
+        string name;
+        int threads = 1;
+        atomic<unsigned long long> items{0};
+        atomic<long long> waitNs{0};
+        atomic<long long> elapsedNs{0};
+    };
+
+    struct IndexBuilder {
+        function<void(const IngestedBook&)> consume;
+        unique_ptr<BoundedQueue<IngestedBook>> queue;
+        unique_ptr<StageMetrics> metrics;
+    };
+
+    string path;
+    SegmentedDynamicArray<Libro>& books;
+    int parserThreads;
+    size_t queueCapacity;
+    StringInterner genres;
+    vector<IndexBuilder> builders;
+    StageMetrics readerMetrics, parserMetrics, internMetrics;
+    unique_ptr<BoundedQueue<Line>> lines;
+    unique_ptr<BoundedQueue<Parsed>> parsed;
+    unsigned long long failedRows = 0;
+    long long totalNs = 0;
+
+    static long long nanosSince(chrono::steady_clock::time_point start) {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    }
+
+    void readStage(ifstream& file) {
+        auto start = chrono::steady_clock::now();
+        string text;
+        unsigned int row = 0;
+        while (getline(file, text)) {
+            readerMetrics.waitNs += lines->push({row++, std::move(text)});
+            ++readerMetrics.items;
+        }
+        lines->producerDone();
+        readerMetrics.elapsedNs += nanosSince(start);
+    }
+
+    void parseStage() {
+        auto start = chrono::steady_clock::now();
+        long long waitNs = 0;
+        Line line;
+        while (lines->pop(line, waitNs)) {
+            Parsed result{line.row, true, Libro()};
+            try {
+                result.libro = parseLibro(line.text);
+            } catch (const exception&) {
+                result.ok = false;
+            }
+            waitNs += parsed->push(std::move(result));
+            ++parserMetrics.items;
+        }
+        parsed->producerDone();
+        parserMetrics.waitNs += waitNs;
+        parserMetrics.elapsedNs += nanosSince(start);
+    }
+
+    void internStage() {
+        auto start = chrono::steady_clock::now();
+        long long waitNs = 0;
+
+        // Reorder buffer: parsers finish rows out of order
+        auto later = [](const Parsed& a, const Parsed& b) { return a.row > b.row; };
+        priority_queue<Parsed, vector<Parsed>, decltype(later)> pending(later);
+        unsigned int nextRow = 0;
+
+        Parsed item;
+        while (parsed->pop(item, waitNs)) {
+            pending.push(std::move(item));
+            while (!pending.empty() && pending.top().row == nextRow) {
+                const Parsed& ready = pending.top();
+                if (ready.ok) {
+                    IngestedBook book{books.size(), genres.intern(ready.libro.genre)};
+                    books.push_back(ready.libro);
+                    for (IndexBuilder& builder : builders) {
+                        waitNs += builder.queue->push(book);
+                    }
+                    ++internMetrics.items;
+                } else {
+                    ++failedRows;
+                }
+                pending.pop();
+                ++nextRow;
+            }
+        }
+        for (IndexBuilder& builder : builders) {
+            builder.queue->producerDone();
+        }
+        internMetrics.waitNs += waitNs;
+        internMetrics.elapsedNs += nanosSince(start);
+    }
+
+    void buildStage(IndexBuilder& builder) {
+        auto start = chrono::steady_clock::now();
+        long long waitNs = 0;
+        IngestedBook book;
+        while (builder.queue->pop(book, waitNs)) {
+            builder.consume(book);
+            ++builder.metrics->items;
+        }
+        builder.metrics->waitNs += waitNs;
+        builder.metrics->elapsedNs += nanosSince(start);
+    }
+
+    void printStage(ostream& out, const StageMetrics& stage, const string& queueInfo) const {
+        ios::fmtflags flags = out.flags();
+        streamsize precision = out.precision();
+        double seconds = stage.elapsedNs.load() / 1e9 / stage.threads;
+        double busy = stage.elapsedNs.load() == 0 ? 0.0
+                    : 100.0 * (stage.elapsedNs.load() - stage.waitNs.load()) / stage.elapsedNs.load();
+        out << "  " << left << setw(22) << stage.name << right
+            << setw(8) << stage.items.load() << " elementos  "
+            << setw(10) << fixed << setprecision(0) << (seconds > 0 ? stage.items.load() / seconds : 0.0) << " /s  "
+            << setw(5) << setprecision(1) << busy << "% ocupado  " << queueInfo << "\n";
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    template <typename Q>
+    static string queueInfo(const Q& queue) {
+        ostringstream info;
+        info << "cola " << fixed << setprecision(1) << queue.averageDepth() << " prom / "
+             << queue.maximumDepth() << " max / " << queue.capacity();
+        return info.str();
+    }
+
+public:
+    IngestPipeline(const string& path, SegmentedDynamicArray<Libro>& books, int parserThreads = 2, size_t queueCapacity = 1024)
+        : path(path), books(books), parserThreads(parserThreads < 1 ? 1 : parserThreads), queueCapacity(queueCapacity) {
+        readerMetrics.name = "lectura";
+        parserMetrics.name = "analisis";
+        parserMetrics.threads = this->parserThreads;
+        internMetrics.name = "internado";
+    }
+
+    // Registers an index builder that runs on its own thread and receives every new book
+    void addIndexBuilder(const string& name, function<void(const IngestedBook&)> consume) {
+        IndexBuilder builder;
+        builder.consume = std::move(consume);
+        builder.queue.reset(new BoundedQueue<IngestedBook>(queueCapacity, 1));
+        builder.metrics.reset(new StageMetrics());
+        builder.metrics->name = name;
+        builders.push_back(std::move(builder));
+    }
+
+    // Throws if the catalog cannot be opened, before any stage starts
+    void run() {
+        auto start = chrono::steady_clock::now();
+        ifstream file(path);
+        if (!file) {
+            throw runtime_error("Error al abrir el archivo " + path);
+        }
+        lines.reset(new BoundedQueue<Line>(queueCapacity, 1));
+        parsed.reset(new BoundedQueue<Parsed>(queueCapacity, parserThreads));
+
+        vector<thread> threads;
+        threads.emplace_back(&IngestPipeline::readStage, this, std::ref(file));
+        for (int p = 0; p < parserThreads; ++p) {
+            threads.emplace_back(&IngestPipeline::parseStage, this);
+        }
+        threads.emplace_back(&IngestPipeline::internStage, this);
+        for (IndexBuilder& builder : builders) {
+            threads.emplace_back(&IngestPipeline::buildStage, this, std::ref(builder));
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        totalNs = nanosSince(start);
+    }
+
+    // Genre names by id; complete once run() returns
+    const StringInterner& genreNames() const {
+        return genres;
+    }
+
+    unsigned long long failed() const {
+        return failedRows;
+    }
+
+    void printMetrics(ostream& out) const {
+        out << "Ingesta en paralelo: " << books.size() << " libros en " << totalNs / 1000 << " microsegundos ("
+            << failedRows << " filas invalidas, " << genres.size() << " generos internados)\n";
+        // Each stage is shown with the depth of its input queue
+        printStage(out, readerMetrics, "");
+        printStage(out, parserMetrics, queueInfo(*lines));
+        printStage(out, internMetrics, queueInfo(*parsed));
+        for (const IndexBuilder& builder : builders) {
+            printStage(out, *builder.metrics, queueInfo(*builder.queue));
+        }
+    }
+};
+
+#endif
@@ -11,6 +11,10 @@
 #include <stdexcept>    // For std::out_of_range
 #include <iostream>     // For std::cout
 #include <vector>       // For std::vector
+#include <algorithm>    // For std::reverse
+#include <type_traits>  // For std::is_same
+#include <new>          // For placement new
+#include "HugePageAllocation_SR.hpp"
 
 /**
  *  Structure that defines a node of a key-value AVL tree.
@@ -31,6 +35,8 @@ struct KeyValueAVLNode {
 
     KeyValueAVLNode* right;     /**< Pointer to the child node on the right side. */
 
+    KeyValueAVLNode* parent;    /**< Pointer to the parent node, nullptr for the root. */
+
 
     /**
      *  Constructs a new KeyValueAVLNode object with the given value.
@@ -45,6 +51,7 @@ struct KeyValueAVLNode {
         height = 1;
         left = nullptr;
         right = nullptr;
+        parent = nullptr;
     }
 
     /**
@@ -57,18 +64,26 @@ struct KeyValueAVLNode {
     {
         key = std::move(k);
         value = std::move(v);
+        height = 1;
         left = nullptr;
         right = nullptr;
+        parent = nullptr;
     }
 };
 
 /**
  *  Class that defines an AVL tree.
  *
- *  @tparam Key     The type of key stored in the node.
- *  @tparam Value   The type of value stored in the node.
+ *  With HeapAllocation every node is allocated with new. With any other allocation policy
+ *  the nodes come from a pool of 2 MB blocks obtained from the policy, so that with
+ *  HugePageAllocation a descent touches a few huge pages instead of one page per node.
+ *  Erased nodes are reused by later insertions and the blocks are released by clear().
+ *
+ *  @tparam Key         The type of key stored in the node.
+ *  @tparam Value       The type of value stored in the node.
+ *  @tparam Allocation  Allocation policy for the nodes, HeapAllocation or HugePageAllocation.
  */
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Allocation = HeapAllocation>
 class KeyValueAVLTree {
 
 public:
@@ -85,6 +100,8 @@ public:
      */
     KeyValueAVLTree(KeyValueAVLNode<Key, Value>* r) 
     {
+        static_assert(std::is_same<Allocation, HeapAllocation>::value,
+                      "Only a tree of nodes allocated with new can adopt them");
         root_ = r;
     }
 
@@ -143,6 +160,12 @@ public:
     {
         clear(root_);
         root_ = nullptr;
+
+        for (void* block : blocks_)
+            Allocation::deallocate(block, POOL_BLOCK_BYTES);
+        blocks_.clear();
+        free_ = nullptr;
+        used_ = NODES_PER_BLOCK;
     }
 
     /**
@@ -167,6 +190,7 @@ public:
     void insert(const Key& key, const Value& value) 
     {
         root_ = insert(root_, key, value);
+        root_->parent = nullptr;
     }
 
     /**
@@ -177,6 +201,8 @@ public:
     void erase(const Key& key)
     {
         root_ = erase(root_, key);
+        if (root_)
+            root_->parent = nullptr;
     }
 
     /**
@@ -269,7 +295,116 @@ public:
 
     return closest;
     }
- 
+
+    /**
+     *  Returns the node with the smallest key that is not less than the given key.
+     *
+     *  @param[in]  key The key to search for.
+     *
+     *  @return Pointer to the lower bound node, or nullptr if every key is smaller.
+     */
+    KeyValueAVLNode<Key, Value>* lower_bound(const Key& key) const
+    {
+        KeyValueAVLNode<Key, Value>* current = root_;
+        KeyValueAVLNode<Key, Value>* bound = nullptr;
+
+        while (current) {
+            if (current->key < key) {
+                current = current->right;
+            }
+            else {
+                bound = current;
+                current = current->left;
+            }
+        }
+
+        return bound;
+    }
+
+    /**
+     *  Returns the next node in inorder. Walking the whole tree this way costs
+     *  amortized O(1) per step and needs no auxiliary stack.
+     *
+     *  @param[in]  node    Pointer to the current node.
+     *
+     *  @return Pointer to the successor of the node, or nullptr if it is the last one.
+     */
+    static KeyValueAVLNode<Key, Value>* successor(const KeyValueAVLNode<Key, Value>* node)
+    {
+        if (node->right != nullptr) {
+            KeyValueAVLNode<Key, Value>* next = node->right;
+            while (next->left != nullptr)
+                next = next->left;
+            return next;
+        }
+
+        while (node->parent != nullptr && node == node->parent->right)
+            node = node->parent;
+
+        return node->parent;
+    }
+
+    /**
+     *  Returns the previous node in inorder. Walking the whole tree this way costs
+     *  amortized O(1) per step and needs no auxiliary stack.
+     *
+     *  @param[in]  node    Pointer to the current node.
+     *
+     *  @return Pointer to the predecessor of the node, or nullptr if it is the first one.
+     */
+    static KeyValueAVLNode<Key, Value>* predecessor(const KeyValueAVLNode<Key, Value>* node)
+    {
+        if (node->left != nullptr) {
+            KeyValueAVLNode<Key, Value>* prev = node->left;
+            while (prev->right != nullptr)
+                prev = prev->right;
+            return prev;
+        }
+
+        while (node->parent != nullptr && node == node->parent->left)
+            node = node->parent;
+
+        return node->parent;
+    }
+
+    /**
+     *  Returns up to k predecessors and k successors around the insertion point of a key.
+     *
+     *  The search descends once to the lower bound of the key and then steps outwards
+     *  through the parent pointers, so the total cost is O(log n + k). If the key is in
+     *  the tree its node is the first successor.
+     *
+     *  @param[in]  key The key around which to search.
+     *  @param[in]  k   The maximum number of nodes to return on each side.
+     *
+     *  @return The nodes found, in ascending order of key.
+     */
+    std::vector<KeyValueAVLNode<Key, Value>*> neighbors(const Key& key, unsigned int k) const
+    {
+        std::vector<KeyValueAVLNode<Key, Value>*> res;
+        if (root_ == nullptr || k == 0)
+            return res;
+
+        KeyValueAVLNode<Key, Value>* first = lower_bound(key);
+
+        // Step backwards from the insertion point
+        KeyValueAVLNode<Key, Value>* node = first ? predecessor(first) : find_max(root_);
+        while (node != nullptr && res.size() < k) {
+            res.push_back(node);
+            node = predecessor(node);
+        }
+        std::reverse(res.begin(), res.end());
+
+        // Step forwards from the insertion point
+        node = first;
+        for (unsigned int i = 0; node != nullptr && i < k; ++i) {
+            res.push_back(node);
+            node = successor(node);
+        }
+
+        return res;
+    }
+
 
 private:
 
@@ -300,9 +435,57 @@ private:
 
         clear(node->left);
         clear(node->right);
-        delete node;        
+        destroy_node(node);
     }    
 
+    /**
+     *  Creates a node, from the pool unless the policy is HeapAllocation.
+     *
+     *  @param[in]  key     The key of the node.
+     *  @param[in]  value   The value of the node.
+     *
+     *  @return Pointer to the new node.
+     */
+    KeyValueAVLNode<Key, Value>* create_node(const Key& key, const Value& value)
+    {
+        if constexpr (std::is_same<Allocation, HeapAllocation>::value) {
+            return new KeyValueAVLNode<Key, Value>(key, value);
+        }
+        else {
+            void* slot;
+            if (free_ != nullptr) {
+                slot = free_;
+                free_ = *static_cast<void**>(slot);
+            }
+            else {
+                if (used_ == NODES_PER_BLOCK) {
+                    blocks_.push_back(Allocation::allocate(POOL_BLOCK_BYTES));
+                    used_ = 0;
+                }
+                slot = static_cast<char*>(blocks_.back()) + used_++ * sizeof(KeyValueAVLNode<Key, Value>);
+            }
+            return new (slot) KeyValueAVLNode<Key, Value>(key, value);
+        }
+    }
+
+    /**
+     *  Destroys a node created by create_node().
+     *
+     *  @param[in]  node    Pointer to the node.
+     */
+    void destroy_node(KeyValueAVLNode<Key, Value>* node)
+    {
+        if constexpr (std::is_same<Allocation, HeapAllocation>::value) {
+            delete node;
+        }
+        else {
+            node->~KeyValueAVLNode<Key, Value>();
+            void* slot = node;
+            *static_cast<void**>(slot) = free_;     // The free list lives in the released nodes
+            free_ = slot;
+        }
+    }
+
     /**
      *  Calculates the height of a node.
      *
@@ -405,11 +588,15 @@ private:
     KeyValueAVLNode<Key, Value>* insert(KeyValueAVLNode<Key, Value>* node, const Key& key, const Value& value)
     {
         if (node == nullptr)
-            node = new KeyValueAVLNode<Key, Value>(key, value);
-        else if (key < node->key)
+            node = create_node(key, value);
+        else if (key < node->key) {
             node->left = insert(node->left, key, value);
-        else if (key > node->key)
+            node->left->parent = node;
+        }
+        else if (key > node->key) {
             node->right = insert(node->right, key, value);
+            node->right->parent = node;
+        }
         else
             return node;
 
@@ -433,15 +620,19 @@ private:
 
         if (key < node->key) {
             node->left = erase(node->left, key);    // The key is in the left subtree
+            if (node->left)
+                node->left->parent = node;
         }
         else if (key > node->key) {
             node->right = erase(node->right, key);  // The key is in the right subtree
+            if (node->right)
+                node->right->parent = node;
         }
         else {
             if (node->left == nullptr || node->right == nullptr) {
                 // The node has one child or no children
                 KeyValueAVLNode<Key, Value>* temp = node->left ? node->left : node->right;
-                delete node;
+                destroy_node(node);
                 return temp;
             }
             else {
@@ -450,6 +641,8 @@ private:
                 node->key = temp->key;
                 node->value = temp->value;
                 node->left = erase(node->left, temp->key);
+                if (node->left)
+                    node->left->parent = node;
             }
         }
 
@@ -469,7 +662,11 @@ private:
     {
         KeyValueAVLNode<Key, Value>* newRoot = node->right;
         node->right = newRoot->left;
+        if (node->right)
+            node->right->parent = node;
         newRoot->left = node;
+        newRoot->parent = node->parent;
+        node->parent = newRoot;
 
         // Update heights
         update_height(node);
@@ -489,7 +686,11 @@ private:
     {
         KeyValueAVLNode<Key, Value>* newRoot = node->left;
         node->left = newRoot->right;
+        if (node->left)
+            node->left->parent = node;
         newRoot->right = node;
+        newRoot->parent = node->parent;
+        node->parent = newRoot;
 
         // Update heights
         update_height(node);
@@ -508,6 +709,7 @@ private:
     KeyValueAVLNode<Key, Value>* rotate_left_right(KeyValueAVLNode<Key, Value>* node)
     {
         node->left = rotate_left(node->left);
+        node->left->parent = node;
         return rotate_right(node);
     }
 
@@ -521,6 +723,7 @@ private:
     KeyValueAVLNode<Key, Value>* rotate_right_left(KeyValueAVLNode<Key, Value>* node)
     {
         node->right = rotate_right(node->right);
+        node->right->parent = node;
         return rotate_left(node);
     }
 
@@ -671,7 +874,17 @@ private:
     }
 
 
+    static constexpr size_t POOL_BLOCK_BYTES = 2 * 1024 * 1024;  /**< Size of a block of the node pool. */
+
+    static constexpr size_t NODES_PER_BLOCK = POOL_BLOCK_BYTES / sizeof(KeyValueAVLNode<Key, Value>);
+
     KeyValueAVLNode<Key, Value>* root_{ nullptr };    /**< Pointer to the root node of the AVL tree. */
+
+    std::vector<void*> blocks_;         /**< Blocks of the node pool, the last one is being filled. */
+
+    size_t used_{ NODES_PER_BLOCK };    /**< Nodes handed out from the last block. */
+
+    void* free_{ nullptr };             /**< Erased nodes of the pool, linked through their storage. */
 };
 
 
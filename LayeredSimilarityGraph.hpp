@@ -0,0 +1,142 @@
+#ifndef LAYERED_SIMILARITY_GRAPH_HPP
+#define LAYERED_SIMILARITY_GRAPH_HPP
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include "WeightedUndirectedGraph.hpp"
+
+using namespace std;
+
+// Relations that two books can share, one bit per layer of the graph
+enum Relation : unsigned char {
+    SAME_AUTHOR    = 1 << 0,
+    SAME_GENRE     = 1 << 1,
+    SAME_YEAR      = 1 << 2,
+    SAME_PUBLISHER = 1 << 3
+};
+
+inline const int RELATION_COUNT = 4;
+
+inline unsigned char relationMask(const Libro& book1, const Libro& book2) {
+    unsigned char mask = 0;
+    if (book1.author == book2.author) mask |= SAME_AUTHOR;
+    if (book1.genre == book2.genre) mask |= SAME_GENRE;
+    if (book1.publication_date == book2.publication_date) mask |= SAME_YEAR;
+    if (book1.publisher == book2.publisher) mask |= SAME_PUBLISHER;
+    return mask;
+}
+
+// Weight of each relation in the similarity score. The defaults reproduce calculateSimilarity.
+struct RelationWeights {
+    double author = 0.3;
+    double genre = 0.3;
+    double year = 0.3;
+    double publisher = 0.0;
+
+    double score(unsigned char mask) const {
+        double similarity = 0.0;
+        if (mask & SAME_AUTHOR) similarity += author;
+        if (mask & SAME_GENRE) similarity += genre;
+        if (mask & SAME_YEAR) similarity += year;
+        if (mask & SAME_PUBLISHER) similarity += publisher;
+        return similarity;
+    }
+};
+
+/*
+ * Multi-relational version of the similarity graph.
+ *
+ * Each edge keeps the bitmask of relations the two books share instead of a single weight, so
+ * the relation weights and the threshold are applied while enumerating neighbors. Ranking
+ * experiments can change them without repeating the O(n^2) build. The build keeps the pairs
+ * that share at least minShared relations; with the default of 1 any weights and threshold can
+ * be evaluated later.
+ */
+class LayeredSimilarityGraph {
+    struct Edge {
+        int neighbor;
+        unsigned char relations;
+    };
+
+    vector<string> titles;                  // Title of each book, by index
+    unordered_map<string, int> titleIndex;  // Title -> index of the book
+    vector<vector<Edge>> adjacencyList;     // Edges of each book, in ascending neighbor order
+
+public:
+    template <typename Container>
+    void build(const Container& libros, int minShared = 1) {
+        titles.clear();
+        titleIndex.clear();
+        adjacencyList.assign(libros.size(), {});
+
+        for (unsigned int i = 0; i < libros.size(); ++i) {
+            titles.push_back(libros[i].title);
+            titleIndex.emplace(libros[i].title, (int)i);
+        }
+
+        for (unsigned int i = 0; i < libros.size(); ++i) {
+            for (unsigned int j = i + 1; j < libros.size(); ++j) {
+                unsigned char mask = relationMask(libros[i], libros[j]);
+                int shared = 0;
+                for (int r = 0; r < RELATION_COUNT; ++r) {
+                    shared += (mask >> r) & 1;
+                }
+                if (mask != 0 && shared >= minShared) {
+                    adjacencyList[i].push_back({(int)j, mask});
+                    adjacencyList[j].push_back({(int)i, mask});
+                }
+            }
+        }
+    }
+
+    int size() const {
+        return (int)titles.size();
+    }
+
+    size_t edgeCount() const {
+        size_t total = 0;
+        for (const auto& edges : adjacencyList) {
+            total += edges.size();
+        }
+        return total / 2;
+    }
+
+    // Returns (neighbor index, 1 - score) pairs in ascending index order for the edges whose score reaches the threshold
+    vector<pair<int, double>> neighbors(int book, const RelationWeights& weights, double threshold) const {
+        // Score of every possible mask, computed once per query
+        double scores[1 << RELATION_COUNT];
+        for (int mask = 0; mask < (1 << RELATION_COUNT); ++mask) {
+            scores[mask] = weights.score((unsigned char)mask);
+        }
+
+        vector<pair<int, double>> result;
+        for (const Edge& edge : adjacencyList[book]) {
+            double similarity = scores[edge.relations];
+            if (similarity >= threshold) {
+                result.emplace_back(edge.neighbor, 1.0 - similarity);
+            }
+        }
+        return result;
+    }
+
+    void displayAdjacent(const string& book, const RelationWeights& weights, double threshold) const {
+        auto it = titleIndex.find(book);
+        vector<pair<int, double>> adjacent;
+        if (it != titleIndex.end()) {
+            adjacent = neighbors(it->second, weights, threshold);
+        }
+
+        if (!adjacent.empty()) {
+            cout << "Libros adyacentes a \"" << book << "\":" << endl;
+            for (const auto& neighbor : adjacent) {
+                cout << " - " << titles[neighbor.first] << " (peso: " << neighbor.second << ")" << endl;
+            }
+        } else {
+            cout << "El libro \"" << book << "\" no tiene libros adyacentes o no esta en el grafo." << endl;
+        }
+    }
+};
+
+#endif
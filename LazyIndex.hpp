@@ -0,0 +1,83 @@
+#ifndef LAZY_INDEX_HPP
+#define LAZY_INDEX_HPP
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <chrono>
+
+using namespace std;
+
+/*
+ * A structure built on first use. ensure() runs the build exactly once even if several threads
+ * call it at the same time; the other callers block until it is done. If the build throws, the
+ * next ensure() tries again. Dependencies are ensured first, outside the timing, so when a log
+ * stream is given the time written for each structure is its own build only and the startup
+ * cost of a run shows which structures the queries needed.
+ */
+class LazyIndex {
+    string name;
+    function<void()> build;
+    ostream* log;
+    vector<LazyIndex*> dependencies;
+    once_flag once;
+    atomic<bool> done{false};
+    double buildSeconds = 0;
+
+public:
+    LazyIndex(const string& name, function<void()> build, ostream* log = nullptr,
+              const vector<LazyIndex*>& dependencies = {})
+        : name(name), build(std::move(build)), log(log), dependencies(dependencies) {}
+
+    LazyIndex(const LazyIndex&) = delete;
+    LazyIndex& operator=(const LazyIndex&) = delete;
+
+    void ensure() {
+        if (built()) {
+            return;
+        }
+        for (LazyIndex* dependency : dependencies) {
+            dependency->ensure();
+        }
+        call_once(once, [this]() {
+            auto start = chrono::steady_clock::now();
+            build();
+            buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            done.store(true, memory_order_release);
+            if (log) {
+                ios::fmtflags flags = log->flags();
+                streamsize precision = log->precision();
+                *log << "[arranque] " << name << " construido en " << fixed << setprecision(3)
+                     << buildSeconds * 1000 << " ms (primer uso)" << endl;
+                log->flags(flags);
+                log->precision(precision);
+            }
+        });
+    }
+
+    // For structures that were built by other means, such as the ingest pipeline
+    void markBuilt() {
+        call_once(once, [this]() {
+            done.store(true, memory_order_release);
+        });
+    }
+
+    bool built() const {
+        return done.load(memory_order_acquire);
+    }
+
+    const string& label() const {
+        return name;
+    }
+
+    // Build time in seconds, 0 if it was not built through ensure()
+    double seconds() const {
+        return buildSeconds;
+    }
+};
+
+#endif
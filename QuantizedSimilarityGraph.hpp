@@ -0,0 +1,152 @@
+#ifndef QUANTIZED_SIMILARITY_GRAPH_HPP
+#define QUANTIZED_SIMILARITY_GRAPH_HPP
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <cmath>
+#include <stdexcept>
+#include "DynamicArray_SR.hpp"
+#include "WeightedUndirectedGraph.hpp"
+
+using namespace std;
+
+// Maps similarity scores in [minScore, maxScore] to evenly spaced integer levels
+class WeightQuantizer {
+    double minScore;
+    double maxScore;
+    int levels;
+
+public:
+    // The default reproduces the scores of calculateSimilarity: 0, 0.3, 0.6 and 0.9 (2 bits)
+    WeightQuantizer(double minScore = 0.0, double maxScore = 0.9, int levels = 4)
+        : minScore(minScore), maxScore(maxScore), levels(levels) {
+        if (levels < 2 || levels > 256 || !(maxScore > minScore)) {
+            throw invalid_argument("Cuantizador invalido");
+        }
+    }
+
+    int levelCount() const {
+        return levels;
+    }
+
+    double step() const {
+        return (maxScore - minScore) / (levels - 1);
+    }
+
+    // Nearest level to the score, clamped to the range
+    unsigned char quantize(double score) const {
+        double position = round((score - minScore) / step());
+        if (position < 0) position = 0;
+        if (position > levels - 1) position = levels - 1;
+        return (unsigned char)position;
+    }
+
+    double dequantize(unsigned char level) const {
+        return minScore + level * step();
+    }
+};
+
+/*
+ * Similarity graph with quantized weights and score-bucketed adjacency (CSR layout).
+ *
+ * The neighbors of each book are stored by level, highest score first, and the start of every
+ * level is kept in levelStart. Edges carry no weight at all, it is implied by their position,
+ * and the top k neighbors of a book are a prefix of its range with no sorting.
+ */
+class QuantizedSimilarityGraph {
+    WeightQuantizer quantizer;
+    vector<string> titles;                  // Title of each book, by index
+    unordered_map<string, int> titleIndex;  // Title -> index of the book
+
+    // Edges of level l of book b: targets[levelStart[b*L + (L-1-l)] .. levelStart[b*L + (L-l)])
+    DynamicArray<unsigned int, HugePageAllocation> levelStart;
+    DynamicArray<unsigned int, HugePageAllocation> targets;
+
+public:
+    explicit QuantizedSimilarityGraph(const WeightQuantizer& quantizer = WeightQuantizer())
+        : quantizer(quantizer) {}
+
+    // Builds the graph from the books and any graph whose neighbors(i) returns (index, 1 - similarity) pairs
+    template <typename Container, typename Source>
+    void build(const Container& libros, const Source& graph) {
+        int L = quantizer.levelCount();
+        titles.clear();
+        titleIndex.clear();
+        levelStart.clear();
+        targets.clear();
+
+        vector<vector<unsigned int>> buckets(L);
+        for (unsigned int i = 0; i < libros.size(); ++i) {
+            titles.push_back(libros[i].title);
+            titleIndex.emplace(libros[i].title, (int)i);
+
+            for (auto& bucket : buckets) {
+                bucket.clear();
+            }
+            for (const auto& neighbor : graph.neighbors((int)i)) {
+                buckets[quantizer.quantize(1.0 - neighbor.second)].push_back((unsigned int)neighbor.first);
+            }
+
+            // Highest level first, each level in the order given by the source
+            for (int level = L - 1; level >= 0; --level) {
+                levelStart.push_back(targets.size());
+                if (!buckets[level].empty()) {
+                    targets.insert(targets.size(), buckets[level].data(), (unsigned int)buckets[level].size());
+                }
+            }
+        }
+        levelStart.push_back(targets.size());
+    }
+
+    int size() const {
+        return (int)titles.size();
+    }
+
+    size_t edgeCount() const {
+        return targets.size() / 2;
+    }
+
+    const WeightQuantizer& weightQuantizer() const {
+        return quantizer;
+    }
+
+    // Returns up to k (neighbor index, weight) pairs with the highest scores, with weight = 1 - similarity
+    vector<pair<int, double>> topK(int book, unsigned int k) const {
+        int L = quantizer.levelCount();
+        vector<pair<int, double>> result;
+        for (int slot = 0; slot < L && result.size() < k; ++slot) {
+            double weight = 1.0 - quantizer.dequantize((unsigned char)(L - 1 - slot));
+            unsigned int end = levelStart[book * L + slot + 1];
+            for (unsigned int e = levelStart[book * L + slot]; e < end && result.size() < k; ++e) {
+                result.emplace_back((int)targets[e], weight);
+            }
+        }
+        return result;
+    }
+
+    vector<pair<int, double>> neighbors(int book) const {
+        int L = quantizer.levelCount();
+        return topK(book, levelStart[(book + 1) * L] - levelStart[book * L]);
+    }
+
+    void displayAdjacent(const string& book, unsigned int k = ~0u) const {
+        auto it = titleIndex.find(book);
+        vector<pair<int, double>> adjacent;
+        if (it != titleIndex.end()) {
+            adjacent = topK(it->second, k);
+        }
+
+        if (!adjacent.empty()) {
+            cout << "Libros adyacentes a \"" << book << "\":" << endl;
+            for (const auto& neighbor : adjacent) {
+                cout << " - " << titles[neighbor.first] << " (peso: " << neighbor.second << ")" << endl;
+            }
+        } else {
+            cout << "El libro \"" << book << "\" no tiene libros adyacentes o no esta en el grafo." << endl;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,298 @@
+//=================================================================================================================
+/**
+ *  Example of implementation of a class that defines segmented dynamic arrays.
+ */
+ //=================================================================================================================
+
+#ifndef SEGMENTED_DYNAMIC_ARRAY_HPP
+#define SEGMENTED_DYNAMIC_ARRAY_HPP
+
+// Includes
+#include <stdexcept>    // For std::out_of_range
+#include <atomic>       // For std::atomic
+#include <type_traits>  // For std::is_trivially_copyable
+#include "HugePageAllocation_SR.hpp"
+
+/**
+ *  Class that defines a dynamic array stored in chunks whose sizes are powers of two.
+ *
+ *  Chunk c holds (1 << FirstChunkBits) << c elements, so indexing is O(1) with a couple of
+ *  bit operations. Growing the array allocates a new chunk and never moves the existing
+ *  elements, which keeps references valid during appends. A single writer may append while
+ *  other threads read any index below size().
+ *
+ *  @tparam T               Type of the elements in the array.
+ *  @tparam FirstChunkBits  Base two logarithm of the size of the first chunk.
+ *  @tparam Allocation      Allocation policy for the chunks of trivially copyable elements.
+ */
+template <typename T, unsigned int FirstChunkBits = 6, typename Allocation = HeapAllocation>
+class SegmentedDynamicArray {
+
+public:
+
+    /**
+     *  Default constructor. The array is empty.
+     */
+    SegmentedDynamicArray() = default;
+
+    /**
+     *  Copy constructor.
+     */
+    SegmentedDynamicArray(const SegmentedDynamicArray& other)
+    {
+        for (unsigned int i = 0; i < other.size(); ++i)
+            push_back(other[i]);
+    }
+
+    /**
+     *  Destructor. Deallocates the memory.
+     */
+    ~SegmentedDynamicArray()
+    {
+        clear();
+    }
+
+    /**
+     *  Copy assignment operator.
+     */
+    SegmentedDynamicArray& operator=(const SegmentedDynamicArray& other)
+    {
+        if (this != &other) {
+            clear();
+            for (unsigned int i = 0; i < other.size(); ++i)
+                push_back(other[i]);
+        }
+
+        return *this;
+    }
+
+    /**
+     *  Returns the size of the array.
+     */
+    unsigned int size() const
+    {
+        return size_.load(std::memory_order_acquire);
+    }
+
+    /**
+     *  Checks if the array is empty.
+     */
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    /**
+     *  Returns the number of elements that fit in the allocated chunks.
+     */
+    unsigned int capacity() const
+    {
+        return chunks_ == 0 ? 0 : chunk_start(chunks_);
+    }
+
+    /**
+     *  Access an element of the array (without bound checking).
+     *
+     *  @param[in]  index   The index of the element to access.
+     *
+     *  @return The element at the given index.
+     */
+    T& operator[](unsigned int index)
+    {
+        unsigned int chunk = chunk_of(index);
+        return segments_[chunk][index - chunk_start(chunk)];
+    }
+
+    /**
+     *  Access an element of the array (without bound checking).
+     *
+     *  @param[in]  index   The index of the element to access.
+     *
+     *  @return The element at the given index.
+     */
+    const T& operator[](unsigned int index) const
+    {
+        unsigned int chunk = chunk_of(index);
+        return segments_[chunk][index - chunk_start(chunk)];
+    }
+
+    /**
+     *  Access an element of the array (with bound checking).
+     *
+     *  @param[in]  index   The index of the element to access.
+     *
+     *  @return The element at the given index.
+     */
+    T& at(unsigned int index)
+    {
+        if (index >= size()) {
+            throw std::out_of_range("Index out of range");
+        }
+        return (*this)[index];
+    }
+
+    /**
+     *  Access an element of the array (with bound checking).
+     *
+     *  @param[in]  index   The index of the element to access.
+     *
+     *  @return The element at the given index.
+     */
+    const T& at(unsigned int index) const
+    {
+        if (index >= size()) {
+            throw std::out_of_range("Index out of range");
+        }
+        return (*this)[index];
+    }
+
+    /**
+     *  Access the first element of the array.
+     */
+    T& front()
+    {
+        return segments_[0][0];
+    }
+
+    /**
+     *  Access the first element of the array.
+     */
+    const T& front() const
+    {
+        return segments_[0][0];
+    }
+
+    /**
+     *  Access the last element of the array.
+     */
+    T& back()
+    {
+        return (*this)[size() - 1];
+    }
+
+    /**
+     *  Access the last element of the array.
+     */
+    const T& back() const
+    {
+        return (*this)[size() - 1];
+    }
+
+    /**
+     *  Inserts a new element at the end of the array. The element becomes visible to
+     *  concurrent readers only after it has been fully written.
+     *
+     *  @param[in]  value   The value to insert.
+     */
+    void push_back(const T& value)
+    {
+        unsigned int index = size_.load(std::memory_order_relaxed);
+        unsigned int chunk = chunk_of(index);
+
+        if (chunk == chunks_) {
+            if (chunk == MAX_CHUNKS) {
+                throw std::length_error("Segmented array is full");
+            }
+            segments_[chunk] = allocate_chunk(chunk);
+            ++chunks_;
+        }
+
+        segments_[chunk][index - chunk_start(chunk)] = value;
+        size_.store(index + 1, std::memory_order_release);
+    }
+
+    /**
+     *  Removes the last element of the array. The chunks are kept for reuse.
+     */
+    void pop_back()
+    {
+        unsigned int n = size_.load(std::memory_order_relaxed);
+        if (n > 0) {
+            size_.store(n - 1, std::memory_order_release);
+        }
+    }
+
+    /**
+     *  Clears the array and deallocates the memory.
+     */
+    void clear()
+    {
+        size_.store(0, std::memory_order_release);
+        for (unsigned int c = 0; c < chunks_; ++c) {
+            deallocate_chunk(c);
+            segments_[c] = nullptr;
+        }
+        chunks_ = 0;
+    }
+
+private:
+
+    static constexpr unsigned int FIRST_CHUNK = 1u << FirstChunkBits;  // Size of the first chunk
+
+    static constexpr unsigned int MAX_CHUNKS = 32 - FirstChunkBits;     // Chunks needed to index 2^32 elements
+
+    /**
+     *  Allocates the storage of a chunk.
+     *
+     *  @param[in]  chunk   The chunk number.
+     */
+    static T* allocate_chunk(unsigned int chunk)
+    {
+        if constexpr (std::is_trivially_copyable<T>::value)
+            return static_cast<T*>(Allocation::allocate((size_t)(FIRST_CHUNK << chunk) * sizeof(T)));
+        else
+            return new T[FIRST_CHUNK << chunk];
+    }
+
+    /**
+     *  Releases the storage of a chunk.
+     *
+     *  @param[in]  chunk   The chunk number.
+     */
+    void deallocate_chunk(unsigned int chunk)
+    {
+        if constexpr (std::is_trivially_copyable<T>::value)
+            Allocation::deallocate(segments_[chunk], (size_t)(FIRST_CHUNK << chunk) * sizeof(T));
+        else
+            delete[] segments_[chunk];
+    }
+
+    /**
+     *  Returns the index of the first element stored in a chunk.
+     *
+     *  @param[in]  chunk   The chunk number.
+     */
+    static unsigned int chunk_start(unsigned int chunk)
+    {
+        return (unsigned int)((((unsigned long long)1 << chunk) - 1) << FirstChunkBits);
+    }
+
+    /**
+     *  Returns the chunk that holds the element at the given index.
+     *
+     *  @param[in]  index   The index of the element.
+     */
+    static unsigned int chunk_of(unsigned int index)
+    {
+        unsigned long long j = ((unsigned long long)index >> FirstChunkBits) + 1;
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(j);
+#else
+        unsigned int chunk = 0;
+        while (j >>= 1)
+            ++chunk;
+        return chunk;
+#endif
+    }
+
+    T* segments_[MAX_CHUNKS]{};         // Pointers to the chunks, never reallocated
+
+    unsigned int chunks_{0};            // Number of allocated chunks
+
+    std::atomic<unsigned int> size_{0}; // Current size of the array, published after each append
+};
+
+#endif
+//=================================================================================================================
+//  END OF FILE
+//=================================================================================================================
@@ -0,0 +1,661 @@
+#ifndef SHARDED_CATALOG_HPP
+#define SHARDED_CATALOG_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include "KeyValueAVLTree.hpp"
+#include "BucketSimilarityGraph.hpp"
+#include "CatalogReader.hpp"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Final step of splitmix64, spreads nearby ids over the whole ring
+inline unsigned long long mixHash(unsigned long long x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/*
+ * Consistent hashing of book ids over the shards. Each shard owns `virtualNodes` points of the
+ * ring and a book goes to the first point at or after the hash of its id, so adding a shard only
+ * moves the books that land on the new points.
+ */
+class ConsistentHashRing {
+    vector<pair<unsigned long long, int>> points;   // (position on the ring, shard), sorted
+    int shards;
+
+public:
+    explicit ConsistentHashRing(int shards, int virtualNodes = 128) : shards(shards) {
+        for (int s = 0; s < shards; ++s) {
+            for (int v = 0; v < virtualNodes; ++v) {
+                points.emplace_back(mixHash(((unsigned long long)s << 32) | (unsigned int)v), s);
+            }
+        }
+        sort(points.begin(), points.end());
+    }
+
+    int shardFor(int id) const {
+        auto it = lower_bound(points.begin(), points.end(), make_pair(mixHash((unsigned int)id), -1));
+        return it == points.end() ? points.front().second : it->second;
+    }
+
+    int size() const {
+        return shards;
+    }
+};
+
+/*
+ * Protocol between the router and the shards, one request per line:
+ *
+ *   P                          ready check, answered with the number of books of the shard
+ *   T <tab> title              book with that title
+ *   C <tab> genre              books of the genre
+ *   S <tab> k <tab> row <tab> csv line
+ *                              the k books of the shard most similar to the book in the csv line,
+ *                              leaving out the one at that catalog row
+ *   Q                          stops the shard
+ *
+ * Each answer is a list of "row <tab> weight <tab> csv line" lines (weight 0 except for S),
+ * ordered by weight and then row, followed by "FIN <microseconds spent by the shard>". If the
+ * request fails the list is replaced by a single "ERR <message>" line, still followed by FIN.
+ */
+struct ShardMatch {
+    int row;            // Line of the book in the catalog, books with the same title keep the first one
+    double weight;
+    Libro book;
+
+    bool operator<(const ShardMatch& other) const {
+        return weight != other.weight ? weight < other.weight : row < other.row;
+    }
+};
+
+namespace shard_detail {
+
+inline string encodeMatch(int row, double weight, const Libro& book) {
+    ostringstream line;
+    line << row << '\t' << setprecision(numeric_limits<double>::max_digits10) << weight << '\t' << formatLibro(book) << '\n';
+    return line.str();
+}
+
+inline ShardMatch decodeMatch(const string& line) {
+    size_t first = line.find('\t');
+    size_t second = line.find('\t', first + 1);
+    if (first == string::npos || second == string::npos) {
+        throw runtime_error("Respuesta invalida de un fragmento: " + line);
+    }
+    return {stoi(line.substr(0, first)), stod(line.substr(first + 1, second - first - 1)), parseLibro(line.substr(second + 1))};
+}
+
+#if defined(__linux__)
+inline bool sendAll(int fd, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += (size_t)n;
+    }
+    return true;
+}
+
+// Splits what arrives on a socket into lines
+class LineReader {
+    int fd;
+    string pending;
+
+public:
+    explicit LineReader(int fd) : fd(fd) {}
+
+    bool next(string& line) {
+        size_t newline;
+        while ((newline = pending.find('\n')) == string::npos) {
+            char buffer[4096];
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            pending.append(buffer, (size_t)n);
+        }
+        line = pending.substr(0, newline);
+        pending.erase(0, newline + 1);
+        return true;
+    }
+};
+#endif
+
+} // namespace shard_detail
+
+/*
+ * The part of the catalog owned by one shard: its books with their catalog rows, a title AVL, a
+ * genre AVL and the similarity graph restricted to its books. Neighbors in other shards are
+ * found by sending them the book itself, so no edge crosses shards.
+ */
+class CatalogShard {
+    vector<Libro> books;
+    vector<int> rows;                                   // Catalog row of each local book
+    KeyValueAVLTree<string, int> titles;
+    KeyValueAVLTree<string, vector<int>> genres;
+    BucketSimilarityGraph graph;
+
+public:
+    CatalogShard(const string& path, const ConsistentHashRing& ring, int shard) {
+        ifstream file(path, ios::binary);
+        if (!file) {
+            throw runtime_error("No se pudo abrir el catalogo " + path);
+        }
+        string line;
+        int row = 0;
+        while (getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+            Libro libro = parseLibro(line);
+            if (ring.shardFor(libro.id) == shard) {
+                int index = (int)books.size();
+                titles.insert(libro.title, index);
+                KeyValueAVLNode<string, vector<int>>* genre = genres.find(libro.genre);
+                if (genre) {
+                    genre->value.push_back(index);
+                } else {
+                    genres.insert(libro.genre, vector<int>(1, index));
+                }
+                graph.addBook(libro);
+                books.push_back(libro);
+                rows.push_back(row);
+            }
+            ++row;
+        }
+    }
+
+    size_t size() const {
+        return books.size();
+    }
+
+    // Answers one request line, without the final FIN line
+    string handle(const string& request) const {
+        string response;
+        size_t tab = request.find('\t');
+        string kind = request.substr(0, tab);
+        string argument = tab == string::npos ? "" : request.substr(tab + 1);
+
+        if (kind == "P") {
+            response = to_string(books.size()) + "\n";
+        } else if (kind == "T") {
+            KeyValueAVLNode<string, int>* node = titles.find(argument);
+            if (node) {
+                response = shard_detail::encodeMatch(rows[node->value], 0.0, books[node->value]);
+            }
+        } else if (kind == "C") {
+            KeyValueAVLNode<string, vector<int>>* node = genres.find(argument);
+            if (node) {
+                for (int index : node->value) {
+                    response += shard_detail::encodeMatch(rows[index], 0.0, books[index]);
+                }
+            }
+        } else if (kind == "S") {
+            istringstream fields(argument);
+            string k, exclude, csv;
+            getline(fields, k, '\t');
+            getline(fields, exclude, '\t');
+            getline(fields, csv);
+            int excludedRow = stoi(exclude);
+
+            // Local indexes follow catalog order, so a stable sort by weight leaves ties by row
+            vector<pair<int, double>> similar = graph.similarTo(parseLibro(csv));
+            stable_sort(similar.begin(), similar.end(),
+                        [](const pair<int, double>& a, const pair<int, double>& b) { return a.second < b.second; });
+            size_t limit = stoul(k);
+            size_t sent = 0;
+            for (const auto& neighbor : similar) {
+                if (sent == limit) {
+                    break;
+                }
+                if (rows[neighbor.first] != excludedRow) {
+                    response += shard_detail::encodeMatch(rows[neighbor.first], neighbor.second, books[neighbor.first]);
+                    ++sent;
+                }
+            }
+        } else {
+            throw runtime_error("Peticion desconocida: " + kind);
+        }
+        return response;
+    }
+};
+
+/*
+ * Starts one process per shard, each listening on a Unix socket of a private directory, and
+ * serves queries by scatter-gather: every request goes to all shards at once and their answers
+ * are merged. The round trip of each shard and the time it spent on the request are recorded.
+ */
+class ShardRouter {
+    struct Shard {
+        pid_t pid = -1;
+        int fd = -1;
+        string socketPath;
+        size_t books = 0;
+        vector<double> latencies;   // Round trip of each request, microseconds
+        double serviceTotal = 0;    // Time spent inside the shard, microseconds
+    };
+
+    string directory;
+    ConsistentHashRing ring;
+    vector<Shard> shards;
+    bool sendFailed = false;    // The last request could not be sent whole
+    string broken;              // Set once the streams cannot be trusted; every request then fails
+
+#if defined(__linux__)
+    // Runs in the forked shard: answers requests until the router sends Q or goes away
+    static void serve(int listening, const string& csvPath, const ConsistentHashRing& ring, int shard) {
+        CatalogShard data(csvPath, ring, shard);
+        while (true) {
+            int client = accept(listening, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            shard_detail::LineReader reader(client);
+            string request;
+            bool stop = false;
+            while (reader.next(request)) {
+                if (request == "Q") {
+                    stop = true;
+                    break;
+                }
+                auto start = chrono::steady_clock::now();
+                string response;
+                try {
+                    response = data.handle(request);
+                } catch (const exception& e) {
+                    string message = e.what();
+                    replace(message.begin(), message.end(), '\n', ' ');
+                    response = "ERR " + message + "\n";
+                }
+                long long micros = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+                if (!shard_detail::sendAll(client, response + "FIN " + to_string(micros) + "\n")) {
+                    break;
+                }
+            }
+            close(client);
+            if (stop) {
+                return;
+            }
+        }
+    }
+
+    void startShard(int index, const string& csvPath) {
+        Shard& shard = shards[index];
+        shard.socketPath = directory + "/fragmento_" + to_string(index) + ".sock";
+
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (shard.socketPath.size() >= sizeof(address.sun_path)) {
+            throw runtime_error("Ruta de socket demasiado larga: " + shard.socketPath);
+        }
+        strcpy(address.sun_path, shard.socketPath.c_str());
+
+        // The socket listens before the fork, so the router can connect while the shard loads
+        int listening = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listening < 0 || bind(listening, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listening, 4) != 0) {
+            throw runtime_error("No se pudo crear el socket " + shard.socketPath + ": " + strerror(errno));
+        }
+
+        cout.flush();
+        cerr.flush();
+        pid_t parent = getpid();
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(listening);
+            throw runtime_error(string("No se pudo iniciar un fragmento: ") + strerror(errno));
+        }
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if (getppid() != parent) {
+                _exit(0);
+            }
+            for (int other = 0; other < index; ++other) {
+                close(shards[other].fd);
+            }
+            try {
+                serve(listening, csvPath, ring, index);
+            } catch (const exception& e) {
+                cerr << "Fragmento " << index << ": " << e.what() << endl;
+            }
+            _exit(0);
+        }
+
+        shard.pid = pid;
+        shard.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool connected = shard.fd >= 0 && connect(shard.fd, (struct sockaddr*)&address, sizeof(address)) == 0;
+        close(listening);
+        if (!connected) {
+            throw runtime_error("No se pudo conectar con el fragmento " + to_string(index) + ": " + strerror(errno));
+        }
+    }
+
+    /*
+     * Reads the rest of the answer of every shard that received the request and has not sent
+     * its FIN yet, so that the next request starts on a clean stream. False if a shard closed
+     * or took longer than `timeoutMs`.
+     */
+    bool drain(const vector<bool>& done, vector<string>& pending, size_t sentTo, int timeoutMs) {
+        for (size_t s = 0; s < sentTo; ++s) {
+            if (done[s]) {
+                continue;
+            }
+            while (true) {
+                size_t newline;
+                bool finished = false;
+                while ((newline = pending[s].find('\n')) != string::npos) {
+                    finished = pending[s].compare(0, 4, "FIN ") == 0;
+                    pending[s].erase(0, newline + 1);
+                    if (finished) {
+                        break;
+                    }
+                }
+                if (finished) {
+                    break;
+                }
+                struct pollfd waiting = {shards[s].fd, POLLIN, 0};
+                if (poll(&waiting, 1, timeoutMs) <= 0) {
+                    return false;
+                }
+                char buffer[65536];
+                ssize_t n = read(shards[s].fd, buffer, sizeof(buffer));
+                if (n <= 0) {
+                    return false;
+                }
+                pending[s].append(buffer, (size_t)n);
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Sends the request to every shard and collects their answers as they arrive. If anything
+     * fails half way, the answers still in flight are drained; if that is not possible the
+     * streams are out of step with the requests and the router refuses every later request
+     * instead of returning stale answers.
+     */
+    vector<vector<ShardMatch>> scatter(const string& request, vector<string>* raw = nullptr) {
+        if (!broken.empty()) {
+            throw runtime_error("Los fragmentos quedaron desincronizados (" + broken + "); reinicie el modo");
+        }
+        vector<bool> done(shards.size(), false);
+        vector<string> pending(shards.size());
+        size_t sentTo = 0;
+        try {
+            return gather(request, raw, done, pending, sentTo);
+        } catch (const exception& e) {
+            // A shard may have received only part of the request, which cannot be resynchronized
+            if (sendFailed || !drain(done, pending, sentTo, 1000)) {
+                broken = e.what();
+            }
+            throw;
+        }
+    }
+
+    vector<vector<ShardMatch>> gather(const string& request, vector<string>* raw, vector<bool>& done,
+                                      vector<string>& pending, size_t& sentTo) {
+        auto sent = chrono::steady_clock::now();
+        sendFailed = false;
+        for (size_t s = 0; s < shards.size(); ++s) {
+            if (!shard_detail::sendAll(shards[s].fd, request + "\n")) {
+                sendFailed = true;
+                throw runtime_error("El fragmento " + to_string(s) + " no responde");
+            }
+            sentTo = s + 1;
+        }
+
+        vector<vector<ShardMatch>> answers(shards.size());
+        string failure;     // First ERR line; the other answers are still read up to their FIN
+        size_t remaining = shards.size();
+        while (remaining > 0) {
+            vector<struct pollfd> waiting;
+            vector<size_t> owners;
+            for (size_t s = 0; s < shards.size(); ++s) {
+                if (!done[s]) {
+                    waiting.push_back({shards[s].fd, POLLIN, 0});
+                    owners.push_back(s);
+                }
+            }
+            if (poll(waiting.data(), waiting.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error(string("poll fallo: ") + strerror(errno));
+            }
+
+            for (size_t w = 0; w < waiting.size(); ++w) {
+                if (!(waiting[w].revents & (POLLIN | POLLHUP | POLLERR))) {
+                    continue;
+                }
+                size_t s = owners[w];
+                char buffer[65536];
+                ssize_t n = read(shards[s].fd, buffer, sizeof(buffer));
+                if (n <= 0) {
+                    throw runtime_error("El fragmento " + to_string(s) + " se cerro");
+                }
+                pending[s].append(buffer, (size_t)n);
+
+                size_t start = 0, newline;
+                while (!done[s] && (newline = pending[s].find('\n', start)) != string::npos) {
+                    string line = pending[s].substr(start, newline - start);
+                    start = newline + 1;
+                    if (line.compare(0, 4, "FIN ") == 0) {
+                        shards[s].latencies.push_back(
+                            chrono::duration<double, micro>(chrono::steady_clock::now() - sent).count());
+                        shards[s].serviceTotal += stod(line.substr(4));
+                        done[s] = true;
+                        --remaining;
+                    } else if (line.compare(0, 4, "ERR ") == 0) {
+                        if (failure.empty()) {
+                            failure = "El fragmento " + to_string(s) + " fallo: " + line.substr(4);
+                        }
+                    } else if (raw) {
+                        (*raw)[s] = line;
+                    } else {
+                        answers[s].push_back(shard_detail::decodeMatch(line));
+                    }
+                }
+                pending[s].erase(0, start);
+            }
+        }
+        if (!failure.empty()) {
+            throw runtime_error(failure);
+        }
+        return answers;
+    }
+#endif
+
+    static double percentile(vector<double> samples, double fraction) {
+        if (samples.empty()) {
+            return 0;
+        }
+        size_t rank = (size_t)(fraction * (samples.size() - 1) + 0.5);
+        nth_element(samples.begin(), samples.begin() + rank, samples.end());
+        return samples[rank];
+    }
+
+public:
+    ShardRouter(const string& csvPath, int shardCount, int virtualNodes = 128)
+        : ring(shardCount, virtualNodes), shards(shardCount) {
+#if defined(__linux__)
+        char pattern[] = "/tmp/fragmentos_XXXXXX";
+        if (!mkdtemp(pattern)) {
+            throw runtime_error(string("No se pudo crear el directorio de sockets: ") + strerror(errno));
+        }
+        directory = pattern;
+        try {
+            for (int s = 0; s < shardCount; ++s) {
+                startShard(s, csvPath);
+            }
+        } catch (...) {
+            shutdown();
+            throw;
+        }
+#else
+        (void)csvPath;
+        throw runtime_error("ShardRouter requiere sockets Unix y fork");
+#endif
+    }
+
+    ~ShardRouter() {
+        shutdown();
+    }
+
+    ShardRouter(const ShardRouter&) = delete;
+    ShardRouter& operator=(const ShardRouter&) = delete;
+
+    // Waits until every shard has loaded its part of the catalog; returns the books of each shard
+    vector<size_t> waitReady() {
+        vector<size_t> counts(shards.size());
+#if defined(__linux__)
+        vector<string> replies(shards.size());
+        scatter("P", &replies);
+        for (size_t s = 0; s < shards.size(); ++s) {
+            shards[s].books = counts[s] = stoul(replies[s]);
+            // The load is not a query, it would dominate the latency of the first request
+            shards[s].latencies.clear();
+            shards[s].serviceTotal = 0;
+        }
+#endif
+        return counts;
+    }
+
+    bool findTitle(const string& title, ShardMatch& match) {
+        bool found = false;
+#if defined(__linux__)
+        for (const vector<ShardMatch>& answer : scatter("T\t" + title)) {
+            for (const ShardMatch& candidate : answer) {
+                if (!found || candidate.row < match.row) {
+                    match = candidate;
+                    found = true;
+                }
+            }
+        }
+#endif
+        return found;
+    }
+
+    // Books of the genre in catalog order
+    vector<ShardMatch> browseCategory(const string& genre) {
+        vector<ShardMatch> merged;
+#if defined(__linux__)
+        for (const vector<ShardMatch>& answer : scatter("C\t" + genre)) {
+            merged.insert(merged.end(), answer.begin(), answer.end());
+        }
+        sort(merged.begin(), merged.end(), [](const ShardMatch& a, const ShardMatch& b) { return a.row < b.row; });
+#endif
+        return merged;
+    }
+
+    // The k books most similar to the one with that title, by weight and then catalog order
+    vector<ShardMatch> recommend(const string& title, size_t k, bool& found) {
+        vector<ShardMatch> merged;
+        ShardMatch book;
+        found = findTitle(title, book);
+#if defined(__linux__)
+        if (found) {
+            for (const vector<ShardMatch>& answer : scatter("S\t" + to_string(k) + "\t" + to_string(book.row) + "\t" + formatLibro(book.book))) {
+                merged.insert(merged.end(), answer.begin(), answer.end());
+            }
+            sort(merged.begin(), merged.end());
+            if (merged.size() > k) {
+                merged.resize(k);
+            }
+        }
+#endif
+        return merged;
+    }
+
+    int shardCount() const {
+        return (int)shards.size();
+    }
+
+    const string& socketDirectory() const {
+        return directory;
+    }
+
+    void printMetrics(ostream& out) const {
+        ios::fmtflags flags = out.flags();
+        streamsize precision = out.precision();
+        out << "  fragmento  libros  peticiones  p50 (us)  p99 (us)  max (us)  servicio medio (us)\n";
+        for (size_t s = 0; s < shards.size(); ++s) {
+            const Shard& shard = shards[s];
+            double worst = shard.latencies.empty() ? 0 : *max_element(shard.latencies.begin(), shard.latencies.end());
+            out << "  " << setw(9) << s << setw(8) << shard.books << setw(12) << shard.latencies.size()
+                << fixed << setprecision(0)
+                << setw(10) << percentile(shard.latencies, 0.50)
+                << setw(10) << percentile(shard.latencies, 0.99)
+                << setw(10) << worst
+                << setw(21) << (shard.latencies.empty() ? 0.0 : shard.serviceTotal / shard.latencies.size()) << "\n";
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    // Stops the shards and removes their sockets; safe to call more than once
+    void shutdown() {
+#if defined(__linux__)
+        for (Shard& shard : shards) {
+            if (shard.fd >= 0) {
+                shard_detail::sendAll(shard.fd, "Q\n");
+                close(shard.fd);
+                shard.fd = -1;
+            } else if (shard.pid > 0) {
+                kill(shard.pid, SIGTERM);   // Started but never connected, it would wait forever
+            }
+            if (shard.pid > 0) {
+                waitpid(shard.pid, nullptr, 0);
+                shard.pid = -1;
+            }
+            if (!shard.socketPath.empty()) {
+                unlink(shard.socketPath.c_str());
+                shard.socketPath.clear();
+            }
+        }
+        if (!directory.empty()) {
+            rmdir(directory.c_str());
+            directory.clear();
+        }
+#endif
+    }
+};
+
+#endif
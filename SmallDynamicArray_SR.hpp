@@ -0,0 +1,354 @@
+//=================================================================================================================
+/**
+ *  Example of implementation of a class that defines dynamic arrays with inline storage.
+ */
+ //=================================================================================================================
+
+#ifndef SMALL_DYNAMIC_ARRAY_HPP
+#define SMALL_DYNAMIC_ARRAY_HPP
+
+// Includes
+#include <stdexcept>    // For std::out_of_range
+#include <new>          // For placement new
+#include <utility>      // For std::move, std::forward
+
+/**
+ *  Class that defines a dynamic array that keeps its first N elements inside the object.
+ *
+ *  Short lists, such as the adjacency list of most books, never touch the heap. Once the
+ *  list grows beyond N elements they are moved to a heap buffer that doubles as needed.
+ *
+ *  @tparam T   Type of the elements in the array.
+ *  @tparam N   Number of elements stored inline.
+ */
+template <typename T, unsigned int N>
+class SmallDynamicArray {
+
+public:
+
+    /**
+     *  Default constructor. The array is empty.
+     */
+    SmallDynamicArray() = default;
+
+    /**
+     *  Copy constructor.
+     */
+    SmallDynamicArray(const SmallDynamicArray& other)
+    {
+        reserve(other.size_);
+        for (unsigned int i = 0; i < other.size_; ++i)
+            new (data_ + i) T(other.data_[i]);
+        size_ = other.size_;
+    }
+
+    /**
+     *  Move constructor. A heap buffer is taken over, inline elements are moved one by one.
+     */
+    SmallDynamicArray(SmallDynamicArray&& other) noexcept
+    {
+        take(other);
+    }
+
+    /**
+     *  Destructor. Destroys the elements and deallocates the memory.
+     */
+    ~SmallDynamicArray()
+    {
+        release();
+    }
+
+    /**
+     *  Copy assignment operator.
+     */
+    SmallDynamicArray& operator=(const SmallDynamicArray& other)
+    {
+        if (this != &other) {
+            clear();
+            reserve(other.size_);
+            for (unsigned int i = 0; i < other.size_; ++i)
+                new (data_ + i) T(other.data_[i]);
+            size_ = other.size_;
+        }
+
+        return *this;
+    }
+
+    /**
+     *  Move assignment operator.
+     */
+    SmallDynamicArray& operator=(SmallDynamicArray&& other) noexcept
+    {
+        if (this != &other) {
+            release();
+            take(other);
+        }
+
+        return *this;
+    }
+
+    /**
+     *  Returns the size of the array.
+     */
+    unsigned int size() const
+    {
+        return size_;
+    }
+
+    /**
+     *  Checks if the array is empty.
+     */
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    /**
+     *  Returns the number of elements that fit without reallocating.
+     */
+    unsigned int capacity() const
+    {
+        return capacity_;
+    }
+
+    /**
+     *  Checks if the elements are stored inside the object.
+     */
+    bool is_inline() const
+    {
+        return data_ == inline_data();
+    }
+
+    /**
+     *  Access an element of the array (without bound checking).
+     *
+     *  @param[in]  index   The index of the element to access.
+     *
+     *  @return The element at the given index.
+     */
+    T& operator[](unsigned int index)
+    {
+        return data_[index];
+    }
+
+    /**
+     *  Access an element of the array (without bound checking).
+     *
+     *  @param[in]  index   The index of the element to access.
+     *
+     *  @return The element at the given index.
+     */
+    const T& operator[](unsigned int index) const
+    {
+        return data_[index];
+    }
+
+    /**
+     *  Access an element of the array (with bound checking).
+     *
+     *  @param[in]  index   The index of the element to access.
+     *
+     *  @return The element at the given index.
+     */
+    T& at(unsigned int index)
+    {
+        if (index >= size_) {
+            throw std::out_of_range("Index out of range");
+        }
+        return data_[index];
+    }
+
+    /**
+     *  Access an element of the array (with bound checking).
+     *
+     *  @param[in]  index   The index of the element to access.
+     *
+     *  @return The element at the given index.
+     */
+    const T& at(unsigned int index) const
+    {
+        if (index >= size_) {
+            throw std::out_of_range("Index out of range");
+        }
+        return data_[index];
+    }
+
+    /**
+     *  Access the first element of the array.
+     */
+    T& front()
+    {
+        return data_[0];
+    }
+
+    /**
+     *  Access the first element of the array.
+     */
+    const T& front() const
+    {
+        return data_[0];
+    }
+
+    /**
+     *  Access the last element of the array.
+     */
+    T& back()
+    {
+        return data_[size_ - 1];
+    }
+
+    /**
+     *  Access the last element of the array.
+     */
+    const T& back() const
+    {
+        return data_[size_ - 1];
+    }
+
+    /**
+     *  Iterators to traverse the array with range-based for loops.
+     */
+    T* begin() { return data_; }
+    T* end() { return data_ + size_; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+
+    /**
+     *  Ensures room for a number of elements. The elements spill to the heap if needed.
+     *
+     *  @param[in]  newCapacity The number of elements that must fit.
+     */
+    void reserve(unsigned int newCapacity)
+    {
+        if (newCapacity <= capacity_)
+            return;
+
+        T* newData = static_cast<T*>(::operator new(sizeof(T) * newCapacity));
+        for (unsigned int i = 0; i < size_; ++i) {
+            new (newData + i) T(std::move(data_[i]));
+            data_[i].~T();
+        }
+
+        if (!is_inline())
+            ::operator delete(data_);
+
+        data_ = newData;
+        capacity_ = newCapacity;
+    }
+
+    /**
+     *  Inserts a new element at the end of the array.
+     *
+     *  @param[in]  value   The value to insert.
+     */
+    void push_back(const T& value)
+    {
+        emplace_back(value);
+    }
+
+    /**
+     *  Constructs a new element at the end of the array.
+     *
+     *  @param[in]  args    The arguments for the constructor of the element.
+     *
+     *  @return The new element.
+     */
+    template <typename... Args>
+    T& emplace_back(Args&&... args)
+    {
+        if (size_ == capacity_) {
+            T value(std::forward<Args>(args)...);   // The arguments may refer to this array
+            reserve(capacity_ > 0 ? capacity_ * 2 : 1);
+            new (data_ + size_) T(std::move(value));
+        }
+        else {
+            new (data_ + size_) T(std::forward<Args>(args)...);
+        }
+
+        return data_[size_++];
+    }
+
+    /**
+     *  Removes the last element of the array.
+     */
+    void pop_back()
+    {
+        if (size_ > 0) {
+            data_[--size_].~T();
+        }
+    }
+
+    /**
+     *  Destroys all the elements. A heap buffer is kept for reuse.
+     */
+    void clear()
+    {
+        for (unsigned int i = 0; i < size_; ++i)
+            data_[i].~T();
+        size_ = 0;
+    }
+
+private:
+
+    /**
+     *  Returns the inline storage as an array of T.
+     */
+    T* inline_data()
+    {
+        return reinterpret_cast<T*>(inline_);
+    }
+
+    const T* inline_data() const
+    {
+        return reinterpret_cast<const T*>(inline_);
+    }
+
+    /**
+     *  Destroys the elements and returns the array to its empty inline state.
+     */
+    void release()
+    {
+        clear();
+        if (!is_inline())
+            ::operator delete(data_);
+
+        data_ = inline_data();
+        capacity_ = N;
+    }
+
+    /**
+     *  Takes the contents of another array, leaving it empty. The array must be empty.
+     *
+     *  @param[in]  other   The array to take the elements from.
+     */
+    void take(SmallDynamicArray& other)
+    {
+        if (other.is_inline()) {
+            for (unsigned int i = 0; i < other.size_; ++i)
+                new (data_ + i) T(std::move(other.data_[i]));
+            size_ = other.size_;
+            other.clear();
+        }
+        else {
+            data_ = other.data_;
+            size_ = other.size_;
+            capacity_ = other.capacity_;
+            other.data_ = other.inline_data();
+            other.size_ = 0;
+            other.capacity_ = N;
+        }
+    }
+
+    alignas(T) unsigned char inline_[sizeof(T) * N];    // Storage for the first N elements
+
+    T* data_{inline_data()};        // Pointer to the inline storage or to the heap buffer
+
+    unsigned int size_{0};          // Current size of the array
+
+    unsigned int capacity_{N};      // Current capacity of the array
+};
+
+#endif
+//=================================================================================================================
+//  END OF FILE
+//=================================================================================================================
@@ -0,0 +1,362 @@
+#ifndef STREAMING_INDEX_BUILDER_HPP
+#define STREAMING_INDEX_BUILDER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <queue>
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <filesystem>
+#include "CatalogReader.hpp"
+
+using namespace std;
+
+/*
+ * Sorted index file produced by StreamingIndexBuilder:
+ *
+ *   entries, sorted by key:   uint32 key length, key bytes, uint32 count, uint64 offsets[count]
+ *   fences:                   uint32 key length, key bytes, uint64 entry position   (every FENCE_STEP entries)
+ *   footer:                   uint64 fence count, uint64 position of the fences
+ *
+ * The offsets are byte offsets of the book lines in the CSV, so a lookup ends with
+ * CatalogReader::readAt and the books never need to be loaded as a whole. A key with more than
+ * POSTING_CHUNK offsets is split into consecutive entries with the same key, so neither the
+ * builder nor a lookup holds more than one chunk of a posting list at a time.
+ */
+const unsigned int FENCE_STEP = 64;
+
+const unsigned int POSTING_CHUNK = 4096;    // Offsets per entry
+
+const size_t MAX_OPEN_RUNS = 128;   // Runs merged at once
+
+inline void writeString(ostream& out, const string& value) {
+    unsigned int length = (unsigned int)value.size();
+    out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.write(value.data(), length);
+}
+
+inline bool readString(istream& in, string& value) {
+    unsigned int length;
+    if (!in.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+        return false;
+    }
+    value.resize(length);
+    return (bool)in.read(&value[0], length);
+}
+
+/*
+ * Builds one key -> book offsets index from records that arrive in batches.
+ *
+ * Postings are buffered until the memory budget is reached, then sorted and spilled as a run
+ * to the work directory. finish() merges the runs and writes the final sorted index file, so
+ * memory stays bounded no matter how large the catalog is.
+ */
+class StreamingIndexBuilder {
+    string name;
+    string workDir;
+    size_t memoryBudget;
+    size_t bufferedBytes = 0;
+    vector<pair<string, unsigned long long>> buffer;
+    vector<string> runs;
+    unsigned long long postings = 0;
+    int nextRun = 0;
+
+    string runPath() {
+        return workDir + "/" + name + "_run_" + to_string(nextRun++) + ".bin";
+    }
+
+    void spill() {
+        if (buffer.empty()) {
+            return;
+        }
+        sort(buffer.begin(), buffer.end());
+        string path = runPath();
+        ofstream out(path, ios::binary);
+        for (const auto& posting : buffer) {
+            writeString(out, posting.first);
+            out.write(reinterpret_cast<const char*>(&posting.second), sizeof(posting.second));
+        }
+        if (!out) {
+            throw runtime_error("No se pudo escribir el archivo temporal " + path);
+        }
+        runs.push_back(path);
+        buffer.clear();
+        bufferedBytes = 0;
+    }
+
+    struct RunReader {
+        ifstream in;
+        string key;
+        unsigned long long offset = 0;
+        bool valid = false;
+
+        explicit RunReader(const string& path) : in(path, ios::binary) {
+            advance();
+        }
+
+        void advance() {
+            valid = readString(in, key) && in.read(reinterpret_cast<char*>(&offset), sizeof(offset));
+        }
+    };
+
+    // K-way merge of a group of runs, passing each posting in order to `emit`, then deletes them
+    template <typename Emit>
+    void mergeRuns(const vector<string>& group, Emit emit) {
+        vector<RunReader*> readers;
+        for (const string& path : group) {
+            readers.push_back(new RunReader(path));
+        }
+        auto later = [&](size_t a, size_t b) {
+            if (readers[a]->key != readers[b]->key) return readers[b]->key < readers[a]->key;
+            return readers[b]->offset < readers[a]->offset;
+        };
+        priority_queue<size_t, vector<size_t>, decltype(later)> heap(later);
+        for (size_t r = 0; r < readers.size(); ++r) {
+            if (readers[r]->valid) {
+                heap.push(r);
+            }
+        }
+
+        while (!heap.empty()) {
+            size_t r = heap.top();
+            heap.pop();
+            emit(readers[r]->key, readers[r]->offset);
+            readers[r]->advance();
+            if (readers[r]->valid) {
+                heap.push(r);
+            }
+        }
+
+        for (RunReader* reader : readers) {
+            delete reader;
+        }
+        for (const string& run : group) {
+            remove(run.c_str());
+        }
+    }
+
+public:
+    StreamingIndexBuilder(const string& name, const string& workDir, size_t memoryBudgetBytes)
+        : name(name), workDir(workDir), memoryBudget(memoryBudgetBytes) {}
+
+    void add(const string& key, unsigned long long offset) {
+        buffer.emplace_back(key, offset);
+        bufferedBytes += key.size() + sizeof(pair<string, unsigned long long>);
+        ++postings;
+        if (bufferedBytes >= memoryBudget) {
+            spill();
+        }
+    }
+
+    unsigned long long postingCount() const {
+        return postings;
+    }
+
+    size_t runCount() const {
+        return runs.size();
+    }
+
+    // Merges the runs into the final index file and returns its path
+    string finish() {
+        spill();
+
+        // Reduce the number of runs until they can be merged in one pass
+        while (runs.size() > MAX_OPEN_RUNS) {
+            vector<string> next;
+            for (size_t first = 0; first < runs.size(); first += MAX_OPEN_RUNS) {
+                vector<string> group(runs.begin() + first, runs.begin() + min(runs.size(), first + MAX_OPEN_RUNS));
+                string path = runPath();
+                ofstream out(path, ios::binary);
+                mergeRuns(group, [&](const string& key, unsigned long long offset) {
+                    writeString(out, key);
+                    out.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+                });
+                next.push_back(path);
+            }
+            runs.swap(next);
+        }
+
+        string path = workDir + "/" + name + ".idx";
+        ofstream out(path, ios::binary);
+        vector<pair<string, unsigned long long>> fences;
+        unsigned long long entries = 0;
+        string currentKey;
+        vector<unsigned long long> offsets;
+
+        offsets.reserve(POSTING_CHUNK);
+
+        auto flush = [&]() {
+            if (offsets.empty()) {
+                return;
+            }
+            if (entries % FENCE_STEP == 0) {
+                fences.emplace_back(currentKey, (unsigned long long)out.tellp());
+            }
+            writeString(out, currentKey);
+            unsigned int count = (unsigned int)offsets.size();
+            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(unsigned long long));
+            offsets.clear();
+            ++entries;
+        };
+
+        mergeRuns(runs, [&](const string& key, unsigned long long offset) {
+            if (key != currentKey || offsets.size() == POSTING_CHUNK) {
+                flush();
+                currentKey = key;
+            }
+            offsets.push_back(offset);
+        });
+        runs.clear();
+        flush();
+
+        unsigned long long fencesPos = (unsigned long long)out.tellp();
+        for (const auto& fence : fences) {
+            writeString(out, fence.first);
+            out.write(reinterpret_cast<const char*>(&fence.second), sizeof(fence.second));
+        }
+        unsigned long long fenceCount = fences.size();
+        out.write(reinterpret_cast<const char*>(&fenceCount), sizeof(fenceCount));
+        out.write(reinterpret_cast<const char*>(&fencesPos), sizeof(fencesPos));
+        if (!out) {
+            throw runtime_error("No se pudo escribir el indice " + path);
+        }
+        return path;
+    }
+};
+
+/*
+ * Lookup on a sorted index file. Only the fences (one key every FENCE_STEP entries) are kept in
+ * memory; a lookup seeks to the last fence before the key, skips at most FENCE_STEP entries and
+ * reads the key's entries one chunk at a time.
+ */
+class SortedIndexFile {
+    mutable ifstream in;
+    vector<pair<string, unsigned long long>> fences;
+    unsigned long long fencesPos = 0;
+
+public:
+    explicit SortedIndexFile(const string& path) : in(path, ios::binary) {
+        if (!in) {
+            throw runtime_error("No se pudo abrir el indice " + path);
+        }
+        unsigned long long fenceCount;
+        in.seekg(-(streamoff)(2 * sizeof(unsigned long long)), ios::end);
+        in.read(reinterpret_cast<char*>(&fenceCount), sizeof(fenceCount));
+        in.read(reinterpret_cast<char*>(&fencesPos), sizeof(fencesPos));
+        in.seekg((streamoff)fencesPos);
+        for (unsigned long long f = 0; f < fenceCount; ++f) {
+            string key;
+            unsigned long long position;
+            readString(in, key);
+            in.read(reinterpret_cast<char*>(&position), sizeof(position));
+            fences.emplace_back(key, position);
+        }
+    }
+
+    size_t fenceCount() const {
+        return fences.size();
+    }
+
+    /*
+     * Calls visit(offset) for every CSV offset stored for the key, in order, until it returns
+     * false. Returns the number of offsets visited, 0 if the key is not in the index.
+     */
+    template <typename Visit>
+    unsigned long long lookup(const string& key, Visit visit) const {
+        // The fence before the first one not below the key: the key's chunks may start right after it
+        auto fence = lower_bound(fences.begin(), fences.end(), key,
+                                 [](const pair<string, unsigned long long>& f, const string& k) { return f.first < k; });
+        if (fence != fences.begin()) {
+            --fence;
+        } else if (fence == fences.end() || fence->first != key) {
+            return 0;
+        }
+
+        in.clear();
+        in.seekg((streamoff)fence->second);
+        string entryKey;
+        vector<unsigned long long> chunk;
+        unsigned long long visited = 0;
+        while ((unsigned long long)in.tellg() < fencesPos) {
+            unsigned int count;
+            if (!readString(in, entryKey) || !in.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+                break;
+            }
+            if (key < entryKey) {
+                break;
+            }
+            if (entryKey != key) {
+                in.seekg((streamoff)(count * sizeof(unsigned long long)), ios::cur);
+                continue;
+            }
+            chunk.resize(min(count, POSTING_CHUNK));
+            if (!in.read(reinterpret_cast<char*>(chunk.data()), chunk.size() * sizeof(unsigned long long))) {
+                break;
+            }
+            for (unsigned long long offset : chunk) {
+                ++visited;
+                if (!visit(offset)) {
+                    return visited;
+                }
+            }
+        }
+        return visited;
+    }
+};
+
+/*
+ * Streaming pipeline for catalogs larger than memory: the CSV is read in batches and every
+ * batch is fed to the title, genre, author, year and publisher index builders.
+ */
+struct StreamingCatalogIndexes {
+    string title;
+    string genre;
+    string author;
+    string year;
+    string publisher;
+    unsigned long long books = 0;
+};
+
+inline StreamingCatalogIndexes buildStreamingIndexes(const string& csvPath, const string& workDir,
+                                                     size_t batchSize, size_t memoryBudgetBytes) {
+    CatalogReader reader(csvPath);
+    if (!reader.good()) {
+        throw runtime_error("Error al abrir el archivo " + csvPath);
+    }
+    filesystem::create_directories(workDir);
+
+    // The budget is shared by the five builders
+    size_t share = max<size_t>(1, memoryBudgetBytes / 5);
+    StreamingIndexBuilder titles("titulo", workDir, share);
+    StreamingIndexBuilder genres("genero", workDir, share);
+    StreamingIndexBuilder authors("autor", workDir, share);
+    StreamingIndexBuilder years("anio", workDir, share);
+    StreamingIndexBuilder publishers("editorial", workDir, share);
+
+    vector<CatalogRecord> batch;
+    batch.reserve(batchSize);
+    while (reader.nextBatch(batch, batchSize)) {
+        for (const CatalogRecord& record : batch) {
+            titles.add(record.libro.title, record.offset);
+            genres.add(record.libro.genre, record.offset);
+            authors.add(record.libro.author, record.offset);
+            years.add(record.libro.publication_date, record.offset);
+            publishers.add(record.libro.publisher, record.offset);
+        }
+    }
+
+    StreamingCatalogIndexes result;
+    result.title = titles.finish();
+    result.genre = genres.finish();
+    result.author = authors.finish();
+    result.year = years.finish();
+    result.publisher = publishers.finish();
+    result.books = reader.rowsRead();
+    return result;
+}
+
+#endif
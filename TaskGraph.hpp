@@ -0,0 +1,239 @@
+#ifndef TASK_GRAPH_HPP
+#define TASK_GRAPH_HPP
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+
+using namespace std;
+
+/*
+ * Fixed-size pool of worker threads fed from a shared FIFO of jobs.
+ */
+class ThreadPool {
+    vector<thread> workers;
+    queue<function<void()>> jobs;
+    mutex lock;
+    condition_variable available;
+    bool stopping = false;
+
+    void work() {
+        while (true) {
+            function<void()> job;
+            {
+                unique_lock<mutex> guard(lock);
+                available.wait(guard, [&]() { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;     // Stopping and nothing left to run
+                }
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+
+public:
+    explicit ThreadPool(unsigned int threads = thread::hardware_concurrency()) {
+        if (threads == 0) {
+            threads = 1;
+        }
+        for (unsigned int t = 0; t < threads; ++t) {
+            workers.emplace_back(&ThreadPool::work, this);
+        }
+    }
+
+    // Runs the pending jobs and joins the workers
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        available.notify_all();
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(function<void()> job) {
+        {
+            lock_guard<mutex> guard(lock);
+            jobs.push(std::move(job));
+        }
+        available.notify_one();
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+};
+
+/*
+ * Dependency graph of build tasks. run() submits every task to the pool as soon as all of its
+ * dependencies have finished, so independent tasks execute concurrently and the total time
+ * approaches the longest chain of dependent tasks. If a task throws, the tasks that depend on
+ * it are skipped and run() rethrows the first exception once everything else has finished.
+ */
+class TaskGraph {
+    struct Task {
+        string name;
+        function<void()> body;
+        vector<int> dependents;
+        int dependencies = 0;
+        int pending = 0;
+        bool skipped = false;
+        double startSeconds = 0;
+        double seconds = 0;
+    };
+
+    vector<Task> tasks;
+    mutex lock;
+    condition_variable finished;
+    size_t completed = 0;
+    exception_ptr failure;
+    chrono::steady_clock::time_point started;
+    double totalSeconds = 0;
+
+    double elapsed() const {
+        return chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    }
+
+    void execute(ThreadPool& pool, int id) {
+        Task& task = tasks[id];
+        bool ok = true;
+        if (!task.skipped) {
+            task.startSeconds = elapsed();
+            try {
+                task.body();
+            } catch (...) {
+                ok = false;
+                lock_guard<mutex> guard(lock);
+                if (!failure) {
+                    failure = current_exception();
+                }
+            }
+            task.seconds = elapsed() - task.startSeconds;
+        }
+
+        // Everything is done under the lock: once `completed` reaches the total, run() may return
+        // and destroy the graph, so this task must not touch it afterwards
+        lock_guard<mutex> guard(lock);
+        for (int dependent : task.dependents) {
+            if (!ok || task.skipped) {
+                tasks[dependent].skipped = true;
+            }
+            if (--tasks[dependent].pending == 0) {
+                pool.submit([this, &pool, dependent]() { execute(pool, dependent); });
+            }
+        }
+        ++completed;
+        finished.notify_all();
+    }
+
+    // Length of the longest chain of dependent tasks ending at each task
+    vector<double> criticalPath() const {
+        vector<double> longest(tasks.size(), 0.0);
+        vector<int> pending(tasks.size());
+        queue<int> ready;
+        for (size_t t = 0; t < tasks.size(); ++t) {
+            pending[t] = tasks[t].dependencies;
+            if (pending[t] == 0) {
+                ready.push((int)t);
+            }
+        }
+        while (!ready.empty()) {
+            int t = ready.front();
+            ready.pop();
+            longest[t] += tasks[t].seconds;
+            for (int dependent : tasks[t].dependents) {
+                longest[dependent] = max(longest[dependent], longest[t]);
+                if (--pending[dependent] == 0) {
+                    ready.push(dependent);
+                }
+            }
+        }
+        return longest;
+    }
+
+public:
+    // Adds a task that runs after every task in `dependencies`; returns its id
+    int addTask(const string& name, function<void()> body, const vector<int>& dependencies = {}) {
+        int id = (int)tasks.size();
+        Task task;
+        task.name = name;
+        task.body = std::move(body);
+        task.dependencies = (int)dependencies.size();
+        tasks.push_back(std::move(task));
+        for (int dependency : dependencies) {
+            if (dependency < 0 || dependency >= id) {
+                throw invalid_argument("Dependencia invalida para la tarea " + name);
+            }
+            tasks[dependency].dependents.push_back(id);
+        }
+        return id;
+    }
+
+    // Runs every task on the pool and waits for all of them
+    void run(ThreadPool& pool) {
+        completed = 0;
+        failure = nullptr;
+        for (Task& task : tasks) {
+            task.pending = task.dependencies;
+            task.skipped = false;
+        }
+        started = chrono::steady_clock::now();
+
+        for (size_t t = 0; t < tasks.size(); ++t) {
+            if (tasks[t].dependencies == 0) {
+                pool.submit([this, &pool, t]() { execute(pool, (int)t); });
+            }
+        }
+        {
+            unique_lock<mutex> guard(lock);
+            finished.wait(guard, [&]() { return completed == tasks.size(); });
+        }
+        totalSeconds = elapsed();
+
+        if (failure) {
+            rethrow_exception(failure);
+        }
+    }
+
+    void printTimings(ostream& out) const {
+        ios::fmtflags flags = out.flags();
+        streamsize precision = out.precision();
+        out << fixed << setprecision(3);
+        double serial = 0;
+        for (const Task& task : tasks) {
+            serial += task.seconds;
+            out << "  " << left << setw(22) << task.name << right;
+            if (task.skipped) {
+                out << " omitida\n";
+            } else {
+                out << " inicio " << setw(7) << task.startSeconds << " s  duracion " << setw(7) << task.seconds << " s\n";
+            }
+        }
+        vector<double> longest = criticalPath();
+        double critical = 0;
+        for (double length : longest) {
+            critical = max(critical, length);
+        }
+        out << "  Total " << totalSeconds << " s (en serie " << serial << " s, camino critico " << critical << " s)\n";
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+#endif
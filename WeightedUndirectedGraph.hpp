@@ -7,6 +7,7 @@
 #include <unordered_set>
 #include <string>
 #include <cmath>
+#include "SmallDynamicArray_SR.hpp"
 
 using namespace std;
 
@@ -34,7 +35,8 @@ struct Libro {
 };
 
 class Graph {
-    unordered_map<string, vector<pair<string, double>>> adjacencyList;
+    // Most books have only a handful of neighbors, the first ones are stored inline without heap allocations
+    unordered_map<string, SmallDynamicArray<pair<string, double>, 4>> adjacencyList;
 
 public:
     void addEdge(const string& book1, const string& book2, double weight) {
@@ -54,7 +56,7 @@ public:
     }
 };
 
-double calculateSimilarity(const Libro& book1, const Libro& book2) {
+inline double calculateSimilarity(const Libro& book1, const Libro& book2) {
     double similarity = 0.0;
     if (book1.author == book2.author) similarity += 0.3;
     if (book1.genre == book2.genre) similarity += 0.3;
@@ -2,29 +2,45 @@
 #include <fstream>
 #include <sstream>
 #include <chrono>
-#include "DynamicArray_SR.hpp"
+#include <memory>
+#include "SegmentedDynamicArray_SR.hpp"
 #include "KeyValueAVLTree.hpp"
 #include <unordered_map>
 #include <chrono>
 #include "WeightedUndirectedGraph.hpp"
+#include "ExternalGraphBuilder.hpp"
+#include "DistributedGraphBuild.hpp"
+#include "CatalogReader.hpp"
+#include "StreamingIndexBuilder.hpp"
+#include "IngestPipeline.hpp"
+#include "TaskGraph.hpp"
+#include "BackgroundBuild.hpp"
+#include "LazyIndex.hpp"
+#include "CatalogWal.hpp"
+#include "HotCatalog.hpp"
+#include "FileWatcher.hpp"
+#include "ShardedCatalog.hpp"
+#include "CatalogFollower.hpp"
+#include "CatalogImage.hpp"
+#include "CompressedSimilarityGraph.hpp"
+#include "LayeredSimilarityGraph.hpp"
+#include "GraphReordering.hpp"
+#include <random>
+#include <climits>
 
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
-using namespace std;
 
-string cleanString(const string& str) { //Se tuvo que recurrir a esta funcion para limpiar los caracteres ya que al parecer algunos tenian caracteres invisibles
-    string cleaned;
-    for (char c : str) {
-        if (isdigit(c)) {
-            cleaned += c;  // Solo agrega caracteres numéricos
-        }
-    }
-    return cleaned;
-}
+using namespace std;
 
-void loadDataIntoArray(const string& filename, DynamicArray<Libro>& arr) {
+void loadDataIntoArray(const string& filename, SegmentedDynamicArray<Libro>& arr) {
     ifstream file(filename);
     string line;
-    int lineNumber = 0;  // Contador para el número de línea
 
     if (!file) {
         cerr << "Error al abrir el archivo" << endl;
@@ -32,32 +48,7 @@ void loadDataIntoArray(const string& filename, DynamicArray<Libro>& arr) {
     }
 
     while (getline(file, line)) {
-
-        stringstream ss(line);
-        string temp;
-        Libro libro;
-
-        getline(ss, temp, ',');
-        temp = cleanString(temp);  // Limpia el ID de caracteres invisibles
-        libro.id = stoi(temp);
-
-        getline(ss, libro.title, ',');
-
-        getline(ss, libro.author, ',');
-
-        getline(ss, libro.genre, ',');
-
-        getline(ss, temp, ',');
-        libro.average_rating = stof(temp);
-
-        getline(ss, temp, ',');
-        libro.num_page = stoi(temp);
-
-        getline(ss, libro.publication_date, ',');
-
-        getline(ss, libro.publisher, ',');
-
-        arr.push_back(libro);
+        arr.push_back(parseLibro(line));
     }
 
     file.close();
@@ -71,23 +62,27 @@ auto medirTiempo(Func&& f) {
     return chrono::duration_cast<chrono::microseconds>(fin - inicio).count();
 }
 
-void construirAVLDeCategorias(const DynamicArray<Libro>& libros, KeyValueAVLTree<string, unordered_map<int, Libro>>& avl) {
-    for (int i = 0; i < libros.size(); i++) {
-        const string& categoria = libros[i].genre;
+void agregarLibroACategoria(const SegmentedDynamicArray<Libro>& libros, int i, KeyValueAVLTree<string, unordered_map<int, Libro>>& avl) {
+    const string& categoria = libros[i].genre;
 
-        KeyValueAVLNode<string, unordered_map<int, Libro>>* nodo = avl.find(categoria);
+    KeyValueAVLNode<string, unordered_map<int, Libro>>* nodo = avl.find(categoria);
 
-        if (nodo) {
-            nodo->value[i] = libros[i];  // Añadir libro al mapa asociado
-        } else {
-            unordered_map<int, Libro> mapa;
-            mapa[i] = libros[i];
-            avl.insert(categoria, mapa);  // Insertar nueva categoría
-        }
+    if (nodo) {
+        nodo->value[i] = libros[i];  // Añadir libro al mapa asociado
+    } else {
+        unordered_map<int, Libro> mapa;
+        mapa[i] = libros[i];
+        avl.insert(categoria, mapa);  // Insertar nueva categoría
+    }
+}
+
+void construirAVLDeCategorias(const SegmentedDynamicArray<Libro>& libros, KeyValueAVLTree<string, unordered_map<int, Libro>>& avl) {
+    for (int i = 0; i < libros.size(); i++) {
+        agregarLibroACategoria(libros, i, avl);
     }
 }
 
-void buscarPorCategoria(const string& categoria, KeyValueAVLTree<string, unordered_map<int, Libro>>& avl) {
+void buscarPorCategoria(const string& categoria, const KeyValueAVLTree<string, unordered_map<int, Libro>>& avl) {
     auto inicio = chrono::high_resolution_clock::now();
 
     KeyValueAVLNode<string, unordered_map<int, Libro>>* nodo = avl.find(categoria);
@@ -108,25 +103,1169 @@ void buscarPorCategoria(const string& categoria, KeyValueAVLTree<string, unorder
     cout << "Tiempo de búsqueda: " << duracion << " microsegundos\n";
 }
 
-int main() {
+// Muestra los vecinos de un libro en un grafo indexado por posición, con el mismo formato que Graph::displayAdjacent
+template <typename ArbolTitulos, typename Grafo>
+void mostrarAdyacentes(const string& titulo, const ArbolTitulos& avl,
+                       const SegmentedDynamicArray<Libro>& libros, const Grafo& grafo) {
+    KeyValueAVLNode<string, int>* nodo = avl.find(titulo);
+    vector<pair<int, double>> adyacentes;
+    if (nodo) {
+        adyacentes = grafo.neighbors(nodo->value);
+    }
+
+    if (!adyacentes.empty()) {
+        cout << "Libros adyacentes a \"" << titulo << "\":" << endl;
+        for (const auto& vecino : adyacentes) {
+            cout << " - " << libros[vecino.first].title << " (peso: " << vecino.second << ")" << endl;
+        }
+    } else {
+        cout << "El libro \"" << titulo << "\" no tiene libros adyacentes o no esta en el grafo." << endl;
+    }
+}
+
+// Modo para catálogos más grandes que la memoria: los índices se construyen por lotes en disco
+// y los libros se leen del CSV por su desplazamiento al consultarlos
+int ejecutarModoStreaming(const string& archivo, const string& directorio, size_t lote, size_t memoriaMB) {
+    StreamingCatalogIndexes indices;
+    unique_ptr<CatalogReader> lector;
+    unique_ptr<SortedIndexFile> indiceTitulos;
+    unique_ptr<SortedIndexFile> indiceGeneros;
+    try {
+        auto tiempoConstruccion = medirTiempo([&]() {
+            indices = buildStreamingIndexes(archivo, directorio, lote, memoriaMB << 20);
+        });
+        cout << "Indices construidos por lotes para " << indices.books << " libros en "
+             << tiempoConstruccion << " microsegundos\n";
+
+        lector.reset(new CatalogReader(archivo));
+        indiceTitulos.reset(new SortedIndexFile(indices.title));
+        indiceGeneros.reset(new SortedIndexFile(indices.genre));
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    string book_name;
+    cout << "Ingrese el título del libro que desea buscar: ";
+    getline(cin, book_name);
+    unsigned long long primero = 0;
+    if (indiceTitulos->lookup(book_name, [&](unsigned long long desplazamiento) {
+            primero = desplazamiento;
+            return false;
+        })) {
+        cout << "\n¡Libro encontrado!\n";
+        cout << "Información completa del libro:\n" << lector->readAt(primero) << endl;
+    } else {
+        cout << "\nLibro no encontrado.\n";
+    }
+
+    while (true) {
+        string categoria;
+        cout << "\nIngrese la categoría que desea buscar (o escriba 'salir' para terminar): ";
+        if (!getline(cin, categoria) || categoria == "salir") {
+            break;
+        }
+
+        // Los desplazamientos se leen del índice por bloques, sin cargar la lista entera
+        bool encontrada = false;
+        indiceGeneros->lookup(categoria, [&](unsigned long long desplazamiento) {
+            if (!encontrada) {
+                cout << "Categoría encontrada: " << categoria << "\n";
+                cout << "Libros en esta categoría:\n";
+                encontrada = true;
+            }
+            cout << lector->readAt(desplazamiento) << "\n";
+            return true;
+        });
+        if (!encontrada) {
+            cout << "Categoría no encontrada: " << categoria << "\n";
+        }
+    }
+
+    return 0;
+}
+
+// Modo de recarga en caliente: cada consulta usa la generación publicada en ese momento. Cuando
+// el CSV cambia solo se aplican las filas nuevas o modificadas; "recargar" reconstruye todo en
+// segundo plano
+int ejecutarModoRecarga(const string& archivo) {
+    HotCatalog catalogo(archivo);
+    auto generacion = catalogo.current();
+    cout << "Generacion " << generacion->number << " construida con " << generacion->books.size()
+         << " libros en " << (long long)(generacion->buildSeconds * 1e6) << " microsegundos\n";
+    unsigned long long generacionVista = generacion->number;
+    generacion.reset();
+
+    FileWatcher vigilante(archivo, [&]() { catalogo.refresh(); });
+    cout << "Vigilando " << archivo << (vigilante.usingInotify() ? " con inotify" : " por sondeo") << "\n";
+
+    while (true) {
+        string linea;
+        cout << "\nComando (titulo <t>, categoria <c>, similares <t>, recargar, estado, salir): ";
+        if (!getline(cin, linea) || linea == "salir") {
+            break;
+        }
+
+        for (const string& evento : catalogo.events()) {
+            cout << "[" << evento << "]\n";
+        }
+
+        // La generación se mantiene viva hasta el final de la consulta aunque se publique otra
+        shared_ptr<const CatalogGeneration> actual = catalogo.current();
+        if (actual->number != generacionVista) {
+            cout << "[generacion " << actual->number << " publicada: " << actual->books.size() << " libros, lista en "
+                 << (long long)(actual->buildSeconds * 1e6) << " microsegundos]\n";
+            generacionVista = actual->number;
+        }
+
+        size_t espacio = linea.find(' ');
+        string comando = linea.substr(0, espacio);
+        string argumento = espacio == string::npos ? "" : linea.substr(espacio + 1);
+        if (comando == "titulo") {
+            KeyValueAVLNode<string, int>* nodo = actual->titles.find(argumento);
+            if (nodo) {
+                cout << "\n¡Libro encontrado!\n";
+                cout << "Información completa del libro:\n" << actual->books[nodo->value] << endl;
+            } else {
+                cout << "\nLibro no encontrado.\n";
+            }
+        } else if (comando == "categoria") {
+            buscarPorCategoria(argumento, actual->genres);
+        } else if (comando == "similares") {
+            mostrarAdyacentes(argumento, actual->titles, actual->books, actual->graph);
+        } else if (comando == "recargar") {
+            cout << (catalogo.reload() ? "Construyendo una nueva generacion en segundo plano\n"
+                                       : "Ya hay una recarga en curso\n");
+        } else if (comando == "estado") {
+            cout << "Generacion publicada: " << actual->number << " (" << actual->books.size() << " libros), "
+                 << "generaciones vivas: " << catalogo.liveGenerations()
+                 << (catalogo.reloading() ? ", recarga en curso" : "") << "\n";
+        } else {
+            cout << "Comando desconocido: " << comando << "\n";
+        }
+    }
+
+    return 0;
+}
+
+// Modo fragmentado: cada fragmento es un proceso con su parte del catálogo, elegida por hash
+// consistente del id, y este proceso reparte cada consulta entre todos por sockets Unix
+int ejecutarModoFragmentos(const string& archivo, int fragmentos, size_t topSimilares) {
+    ShardRouter enrutador(archivo, fragmentos);
+    vector<size_t> librosPorFragmento;
+    auto tiempoArranque = medirTiempo([&]() {
+        librosPorFragmento = enrutador.waitReady();
+    });
+    cout << fragmentos << " fragmentos listos en " << tiempoArranque << " microsegundos (sockets en "
+         << enrutador.socketDirectory() << "), libros por fragmento:";
+    for (size_t libros : librosPorFragmento) {
+        cout << " " << libros;
+    }
+    cout << "\n";
+
+    while (true) {
+        string linea;
+        cout << "\nComando (titulo <t>, categoria <c>, similares <t>, metricas, salir): ";
+        if (!getline(cin, linea) || linea == "salir") {
+            break;
+        }
+
+        size_t espacio = linea.find(' ');
+        string comando = linea.substr(0, espacio);
+        string argumento = espacio == string::npos ? "" : linea.substr(espacio + 1);
+        try {
+            if (comando == "titulo") {
+                ShardMatch encontrado;
+                if (enrutador.findTitle(argumento, encontrado)) {
+                    cout << "\n¡Libro encontrado!\n";
+                    cout << "Información completa del libro:\n" << encontrado.book << endl;
+                } else {
+                    cout << "\nLibro no encontrado.\n";
+                }
+            } else if (comando == "categoria") {
+                vector<ShardMatch> libros;
+                auto duracion = medirTiempo([&]() {
+                    libros = enrutador.browseCategory(argumento);
+                });
+                if (!libros.empty()) {
+                    cout << "Categoría encontrada: " << argumento << "\n";
+                    cout << "Libros en esta categoría:\n";
+                    for (const ShardMatch& libro : libros) {
+                        cout << libro.book << "\n";
+                    }
+                } else {
+                    cout << "Categoría no encontrada: " << argumento << "\n";
+                }
+                cout << "Tiempo de búsqueda: " << duracion << " microsegundos\n";
+            } else if (comando == "similares") {
+                bool encontrado = false;
+                vector<ShardMatch> similares = enrutador.recommend(argumento, topSimilares, encontrado);
+                if (!similares.empty()) {
+                    cout << "Libros adyacentes a \"" << argumento << "\":" << endl;
+                    for (const ShardMatch& vecino : similares) {
+                        cout << " - " << vecino.book.title << " (peso: " << vecino.weight << ")" << endl;
+                    }
+                } else {
+                    cout << "El libro \"" << argumento << "\" no tiene libros adyacentes o no esta en el grafo." << endl;
+                }
+            } else if (comando == "metricas") {
+                enrutador.printMetrics(cout);
+            } else {
+                cout << "Comando desconocido: " << comando << "\n";
+            }
+        } catch (const exception& e) {
+            cout << "Error: " << e.what() << "\n";
+        }
+    }
+
+    cout << "Latencia por fragmento:\n";
+    enrutador.printMetrics(cout);
+    return 0;
+}
+
+// Modo seguidor: réplica de solo lectura de un directorio --wal que aplica el WAL del líder a
+// medida que se escribe; una consulta espera si la réplica está más atrasada que retrasoMaximo
+int ejecutarModoSeguidor(const string& directorio, int retrasoMaximo) {
+    unique_ptr<CatalogFollower> seguidor;
+    long long tiempoArranque;
+    try {
+        tiempoArranque = medirTiempo([&]() {
+            seguidor.reset(new CatalogFollower(directorio, chrono::milliseconds(10), chrono::milliseconds(retrasoMaximo)));
+        });
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    cout << "Replica de " << directorio << " con " << seguidor->size() << " libros, cargada en " << tiempoArranque
+         << " microsegundos\n";
+
+    while (true) {
+        string linea;
+        cout << "\nComando (titulo <t>, categoria <c>, similares <t>, replicacion, salir): ";
+        if (!getline(cin, linea) || linea == "salir") {
+            break;
+        }
+
+        size_t espacio = linea.find(' ');
+        string comando = linea.substr(0, espacio);
+        string argumento = espacio == string::npos ? "" : linea.substr(espacio + 1);
+        try {
+            if (comando == "titulo") {
+                Libro libro;
+                if (seguidor->findTitle(argumento, libro)) {
+                    cout << "\n¡Libro encontrado!\n";
+                    cout << "Información completa del libro:\n" << libro << endl;
+                } else {
+                    cout << "\nLibro no encontrado.\n";
+                }
+            } else if (comando == "categoria") {
+                vector<Libro> libros;
+                auto duracion = medirTiempo([&]() {
+                    libros = seguidor->booksInGenre(argumento);
+                });
+                if (!libros.empty()) {
+                    cout << "Categoría encontrada: " << argumento << "\n";
+                    cout << "Libros en esta categoría:\n";
+                    for (const Libro& libro : libros) {
+                        cout << libro << "\n";
+                    }
+                } else {
+                    cout << "Categoría no encontrada: " << argumento << "\n";
+                }
+                cout << "Tiempo de búsqueda: " << duracion << " microsegundos\n";
+            } else if (comando == "similares") {
+                vector<pair<Libro, double>> similares = seguidor->similar(argumento);
+                if (!similares.empty()) {
+                    cout << "Libros adyacentes a \"" << argumento << "\":" << endl;
+                    for (const auto& vecino : similares) {
+                        cout << " - " << vecino.first.title << " (peso: " << vecino.second << ")" << endl;
+                    }
+                } else {
+                    cout << "El libro \"" << argumento << "\" no tiene libros adyacentes o no esta en el grafo." << endl;
+                }
+            } else if (comando == "replicacion") {
+                seguidor->printMetrics(cout);
+            } else {
+                cout << "Comando desconocido: " << comando << "\n";
+            }
+        } catch (const exception& e) {
+            cout << "Error: " << e.what() << "\n";
+        }
+    }
+
+    seguidor->printMetrics(cout);
+    return 0;
+}
+
+// Aplica mutaciones al catálogo persistente hasta que se ingresa una línea vacía
+void editarCatalogo(CatalogStore& almacen) {
+    while (true) {
+        string linea;
+        cout << "\nMutación del catálogo (agregar <linea csv>, actualizar <linea csv>, eliminar <id>, checkpoint; vacío para continuar): ";
+        if (!getline(cin, linea) || linea.empty()) {
+            break;
+        }
+
+        size_t espacio = linea.find(' ');
+        string comando = linea.substr(0, espacio);
+        string argumento = espacio == string::npos ? "" : linea.substr(espacio + 1);
+        try {
+            if (comando == "agregar") {
+                almacen.add(parseLibro(argumento));
+                cout << "Libro agregado\n";
+            } else if (comando == "actualizar") {
+                almacen.update(parseLibro(argumento));
+                cout << "Libro actualizado\n";
+            } else if (comando == "eliminar") {
+                almacen.remove(stoi(argumento));
+                cout << "Libro eliminado\n";
+            } else if (comando == "checkpoint") {
+                almacen.checkpoint();
+                cout << "Snapshot escrito y WAL truncado\n";
+            } else {
+                cout << "Comando desconocido: " << comando << "\n";
+            }
+        } catch (const exception& e) {
+            cout << "Error: " << e.what() << "\n";
+        }
+    }
+}
+
+// Representaciones alternativas del grafo de similitud. Cada una se construye a partir del grafo
+// por cubetas, se compara con él y responde las consultas de similares:
+//   comprimido: listas de adyacencia comprimidas al estilo WebGraph
+//   capas: cada arista guarda las relaciones que comparten los libros; "pesos <autor> <genero>
+//          <anio> <editorial>" y "umbral <valor>" cambian la puntuación sin reconstruir
+//   cuantizado: pesos cuantizados y vecinos agrupados por nivel; devuelve los `topSimilares` mejores
+int ejecutarModoGrafoAlternativo(const string& archivo, const string& variante, size_t topSimilares) {
+    if (variante != "comprimido" && variante != "capas" && variante != "cuantizado") {
+        cerr << "Variante de grafo desconocida: " << variante << endl;
+        return 1;
+    }
+    SegmentedDynamicArray<Libro> libros;
+    loadDataIntoArray(archivo, libros);
+    BucketSimilarityGraph base;
+    auto tiempoBase = medirTiempo([&]() { base.build(libros); });
+    cout << "Grafo por cubetas: " << libros.size() << " libros en " << tiempoBase << " microsegundos\n";
+
+    // Cuántos libros tienen exactamente los mismos vecinos que en el grafo por cubetas
+    auto verificar = [&](function<vector<pair<int, double>>(int)> vecinos) {
+        size_t iguales = 0;
+        auto tiempo = medirTiempo([&]() {
+            for (unsigned int i = 0; i < libros.size(); ++i) {
+                vector<pair<int, double>> esperados = base.neighbors((int)i), obtenidos = vecinos((int)i);
+                sort(obtenidos.begin(), obtenidos.end());
+                bool igual = esperados.size() == obtenidos.size();
+                for (size_t k = 0; igual && k < esperados.size(); ++k) {
+                    igual = esperados[k].first == obtenidos[k].first;
+                }
+                iguales += igual;
+            }
+        });
+        cout << "Vecinos iguales al grafo por cubetas en " << iguales << " de " << libros.size()
+             << " libros; recorrido completo en " << tiempo << " microsegundos\n";
+    };
+
+    function<void(const string&)> mostrar;
+    CompressedSimilarityGraph comprimido;
+    LayeredSimilarityGraph capas;
+    QuantizedSimilarityGraph cuantizado;
+    RelationWeights pesos;
+    double umbral = 0.6;
+    if (variante == "comprimido") {
+        cout << "Construccion: " << medirTiempo([&]() { comprimido.build(libros, base); }) << " microsegundos\n";
+        comprimido.displayStats();
+        verificar([&](int libro) { return comprimido.neighbors(libro); });
+        mostrar = [&](const string& titulo) { comprimido.displayAdjacent(titulo); };
+    } else if (variante == "cuantizado") {
+        cout << "Construccion: " << medirTiempo([&]() { cuantizado.build(libros, base); }) << " microsegundos, "
+             << cuantizado.edgeCount() << " aristas\n";
+        verificar([&](int libro) { return cuantizado.neighbors(libro); });
+        mostrar = [&](const string& titulo) { cuantizado.displayAdjacent(titulo, (unsigned int)topSimilares); };
+    } else if (variante == "capas") {
+        // Se guarda todo par con alguna relación en común, así cualquier peso o umbral se responde
+        // sin reconstruir (unas 6.8 millones de aristas, 160 MB, en el catálogo de ejemplo)
+        cout << "Construccion: " << medirTiempo([&]() { capas.build(libros); }) << " microsegundos, "
+             << capas.edgeCount() << " aristas con alguna relacion\n";
+        verificar([&](int libro) { return capas.neighbors(libro, pesos, umbral); });
+        mostrar = [&](const string& linea) {
+            istringstream comando(linea);
+            string palabra;
+            comando >> palabra;
+            if (palabra == "pesos") {
+                RelationWeights nuevos;
+                if (comando >> nuevos.author >> nuevos.genre >> nuevos.year >> nuevos.publisher) {
+                    pesos = nuevos;
+                    cout << "Pesos actualizados\n";
+                } else {
+                    cout << "Uso: pesos <autor> <genero> <anio> <editorial>\n";
+                }
+            } else if (palabra == "umbral") {
+                if (comando >> umbral) {
+                    cout << "Umbral actualizado\n";
+                } else {
+                    cout << "Uso: umbral <valor>\n";
+                }
+            } else {
+                capas.displayAdjacent(linea, pesos, umbral);
+            }
+        };
+    }
+
+    string titulo;
+    while (true) {
+        cout << "\nNombre del libro para ver sus similares (o 'salir'): ";
+        if (!getline(cin, titulo) || titulo == "salir") {
+            break;
+        }
+        mostrar(titulo);
+    }
+    return 0;
+}
+
+// Cuenta los fallos de TLB de datos del proceso mientras está activo, si el kernel lo permite
+struct ContadorTlb {
+    int fd = -1;
+
+    ContadorTlb() {
+#if defined(__linux__)
+        perf_event_attr atributos;
+        memset(&atributos, 0, sizeof(atributos));
+        atributos.size = sizeof(atributos);
+        atributos.type = PERF_TYPE_HW_CACHE;
+        atributos.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        atributos.disabled = 1;
+        atributos.exclude_kernel = 1;
+        atributos.exclude_hv = 1;
+        fd = (int)syscall(__NR_perf_event_open, &atributos, 0, -1, -1, 0);
+#endif
+    }
+
+    ~ContadorTlb() {
+#if defined(__linux__)
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    bool disponible() const {
+        return fd >= 0;
+    }
+
+    // Fallos durante f(), o 0 si no hay contador
+    template <typename Func>
+    unsigned long long medir(Func&& f) {
+        unsigned long long fallos = 0;
+#if defined(__linux__)
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        f();
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &fallos, sizeof(fallos)) != (ssize_t)sizeof(fallos)) {
+                fallos = 0;
+            }
+        }
+#else
+        f();
+#endif
+        return fallos;
+    }
+};
+
+// Memoria anónima del proceso respaldada por páginas de 2 MB, en KB
+long long paginasGrandesEnUso() {
+    ifstream resumen("/proc/self/smaps_rollup");
+    string linea;
+    while (getline(resumen, linea)) {
+        if (linea.compare(0, 14, "AnonHugePages:") == 0) {
+            return stoll(linea.substr(14));
+        }
+    }
+    return -1;
+}
+
+struct MedicionPaginas {
+    long long microsegundos = 0;
+    unsigned long long fallosTlb = 0;
+    long long kbEnPaginasGrandes = 0;
+};
+
+// Búsquedas de todos los títulos, en orden aleatorio, en un árbol cuyos nodos vienen de `Politica`
+template <typename Politica>
+MedicionPaginas medirArbolTitulos(const vector<Libro>& libros, const vector<int>& orden, int pasadas, ContadorTlb& contador) {
+    MedicionPaginas medicion;
+    long long antes = paginasGrandesEnUso();
+    KeyValueAVLTree<string, int, Politica> arbol;
+    for (size_t i = 0; i < libros.size(); ++i) {
+        arbol.insert(libros[i].title, (int)i);
+    }
+    medicion.kbEnPaginasGrandes = paginasGrandesEnUso() - antes;
+    long long encontrados = 0;
+    medicion.microsegundos = medirTiempo([&]() {
+        medicion.fallosTlb = contador.medir([&]() {
+            for (int p = 0; p < pasadas; ++p) {
+                for (int i : orden) {
+                    encontrados += arbol.find(libros[i].title) != nullptr;
+                }
+            }
+        });
+    });
+    if (encontrados != (long long)orden.size() * pasadas) {
+        throw runtime_error("Faltan titulos en el arbol de prueba");
+    }
+    return medicion;
+}
+
+// Iteraciones de PageRank sobre un CSR cuyos arreglos vienen de `Politica`
+template <typename Politica, typename Grafo>
+MedicionPaginas medirGrafoCsr(const Grafo& grafo, int iteraciones, ContadorTlb& contador) {
+    MedicionPaginas medicion;
+    long long antes = paginasGrandesEnUso();
+    size_t n = (size_t)grafo.size();
+    vector<unsigned long long, PolicyAllocator<unsigned long long, Politica>> inicio(n + 1, 0);
+    vector<unsigned int, PolicyAllocator<unsigned int, Politica>> destinos;
+    for (size_t i = 0; i < n; ++i) {
+        for (const auto& vecino : grafo.neighbors((int)i)) {
+            destinos.push_back((unsigned int)vecino.first);
+        }
+        inicio[i + 1] = destinos.size();
+    }
+    vector<double, PolicyAllocator<double, Politica>> rango(n, 1.0 / n), siguiente(n, 0.0);
+    medicion.kbEnPaginasGrandes = paginasGrandesEnUso() - antes;
+    medicion.microsegundos = medirTiempo([&]() {
+        medicion.fallosTlb = contador.medir([&]() {
+            for (int it = 0; it < iteraciones; ++it) {
+                for (size_t i = 0; i < n; ++i) {
+                    double suma = 0;
+                    for (unsigned long long e = inicio[i]; e < inicio[i + 1]; ++e) {
+                        unsigned int j = destinos[e];
+                        suma += rango[j] / (double)(inicio[j + 1] - inicio[j]);
+                    }
+                    siguiente[i] = 0.15 / n + 0.85 * suma;
+                }
+                rango.swap(siguiente);
+            }
+        });
+    });
+    return medicion;
+}
+
+// Compara páginas normales con páginas de 2 MB en el árbol de títulos y en el grafo CSR. El
+// catálogo se replica `copias` veces (cada copia con sus propios autores) para que las estructuras
+// superen lo que cubre el TLB con páginas de 4 KB.
+int ejecutarMedicionPaginasGrandes(const string& archivo, int copias) {
+    SegmentedDynamicArray<Libro> original;
+    loadDataIntoArray(archivo, original);
+    vector<Libro> libros;
+    for (int c = 0; c < copias; ++c) {
+        for (unsigned int i = 0; i < original.size(); ++i) {
+            Libro libro = original[i];
+            libro.id += c * (int)original.size();
+            if (c > 0) {
+                libro.title += "#" + to_string(c);
+                libro.author += "#" + to_string(c);
+            }
+            libros.push_back(libro);
+        }
+    }
+    vector<int> orden(libros.size());
+    for (size_t i = 0; i < orden.size(); ++i) {
+        orden[i] = (int)i;
+    }
+    shuffle(orden.begin(), orden.end(), mt19937(12345));
+    BucketSimilarityGraph grafo;
+    grafo.build(libros);
+
+    ContadorTlb contador;
+    cout << libros.size() << " libros (" << copias << " copias del catalogo); contador de fallos de TLB "
+         << (contador.disponible() ? "activo" : "no disponible (perf_event_open denegado)") << "\n";
+    auto mostrar = [](const string& nombre, const MedicionPaginas& normal, const MedicionPaginas& grandes, bool conTlb) {
+        cout << nombre << ": " << normal.microsegundos << " us con paginas normales, " << grandes.microsegundos
+             << " us con paginas de 2 MB (" << grandes.kbEnPaginasGrandes << " KB respaldados por paginas grandes)";
+        if (conTlb) {
+            cout << "; fallos de TLB " << normal.fallosTlb << " -> " << grandes.fallosTlb;
+        }
+        cout << "\n";
+    };
+    // Una pasada de calentamiento de cada variante antes de medir
+    medirArbolTitulos<HeapAllocation>(libros, orden, 1, contador);
+    medirArbolTitulos<HugePageAllocation>(libros, orden, 1, contador);
+    mostrar("Arbol de titulos (5 pasadas de busquedas)", medirArbolTitulos<HeapAllocation>(libros, orden, 5, contador),
+            medirArbolTitulos<HugePageAllocation>(libros, orden, 5, contador), contador.disponible());
+    mostrar("Grafo CSR (20 iteraciones de PageRank)", medirGrafoCsr<HeapAllocation>(grafo, 20, contador),
+            medirGrafoCsr<HugePageAllocation>(grafo, 20, contador), contador.disponible());
+    return 0;
+}
+
+// Orden de los libros para --orden-grafo (orden[nuevo] = viejo), vacío si el nombre no es válido
+template <typename Libros>
+vector<int> calcularOrden(const string& nombre, const Libros& libros, const BucketSimilarityGraph& grafo) {
+    if (nombre == "grado") {
+        return degreeOrder(grafo);
+    }
+    if (nombre == "rcm") {
+        return reverseCuthillMcKee(grafo);
+    }
+    if (nombre == "atributos") {
+        return attributeOrder(libros);
+    }
+    return {};
+}
+
+// Compara el orden del CSV con cada reordenamiento: distancia entre vecinos, tamaño del grafo
+// comprimido y tiempo de PageRank sobre el CSR
+int ejecutarComparacionOrdenes(const string& archivo) {
+    SegmentedDynamicArray<Libro> libros;
+    loadDataIntoArray(archivo, libros);
+    BucketSimilarityGraph grafo;
+    grafo.build(libros);
+    ContadorTlb contador;
+
+    for (const string& nombre : {string("csv"), string("grado"), string("rcm"), string("atributos")}) {
+        vector<int> orden;
+        auto tiempoOrden = medirTiempo([&]() { orden = calcularOrden(nombre, libros, grafo); });
+        if (orden.empty()) {
+            for (unsigned int i = 0; i < libros.size(); ++i) {
+                orden.push_back((int)i);
+            }
+        }
+        RelabeledGraph<BucketSimilarityGraph> reordenado(grafo, orden);
+
+        // Bits medios de la distancia entre un libro y cada vecino, lo que cuesta un salto en el CSR
+        double bitsDistancia = 0;
+        unsigned long long arcos = 0;
+        for (int i = 0; i < reordenado.size(); ++i) {
+            for (const auto& vecino : reordenado.neighbors(i)) {
+                bitsDistancia += log2(abs(vecino.first - i) + 1.0);
+                ++arcos;
+            }
+        }
+
+        vector<Libro> permutados(libros.size());
+        for (size_t k = 0; k < orden.size(); ++k) {
+            permutados[k] = libros[(unsigned int)orden[k]];
+        }
+        CompressedSimilarityGraph comprimido;
+        comprimido.build(permutados, reordenado);
+
+        MedicionPaginas pagerank = medirGrafoCsr<HeapAllocation>(reordenado, 20, contador);
+        cout << left << setw(10) << nombre << right << " orden en " << setw(7) << tiempoOrden << " us, "
+             << fixed << setprecision(2) << bitsDistancia / max<unsigned long long>(1, arcos)
+             << " bits de distancia por arco, " << comprimido.bitsPerArc() << " bits por arco comprimido, PageRank "
+             << pagerank.microsegundos << " us";
+        if (contador.disponible()) {
+            cout << " (" << pagerank.fallosTlb << " fallos de TLB)";
+        }
+        cout << defaultfloat << setprecision(6) << "\n";
+    }
+    return 0;
+}
+
+// Modo imagen: el catálogo, los índices y el grafo se leen de una base binaria mapeada en memoria
+// más los deltas guardados desde entonces; "guardar" escribe en un delta solo lo que cambió en
+// `fuente` y "compactar" vuelca todo en una base nueva
+int ejecutarModoImagen(const string& directorio, const function<void(SegmentedDynamicArray<Libro>&)>& fuente) {
+    unique_ptr<CatalogImage> imagen;
+    long long tiempoApertura;
+    try {
+        tiempoApertura = medirTiempo([&]() {
+            imagen.reset(new CatalogImage(directorio));
+        });
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    if (!imagen->hasBase()) {
+        SegmentedDynamicArray<Libro> libros;
+        fuente(libros);
+        CatalogImage::CommitStats base = imagen->commit(libros);
+        cout << "Base escrita con " << base.books << " libros (" << base.bytes / 1024 << " KB)\n";
+    } else {
+        cout << "Imagen abierta en " << tiempoApertura << " microsegundos\n";
+    }
+    imagen->printMetrics(cout);
+
+    while (true) {
+        string linea;
+        cout << "\nComando (titulo <t>, categoria <c>, similares <t>, guardar, compactar, imagen, salir): ";
+        if (!getline(cin, linea) || linea == "salir") {
+            break;
+        }
+
+        size_t espacio = linea.find(' ');
+        string comando = linea.substr(0, espacio);
+        string argumento = espacio == string::npos ? "" : linea.substr(espacio + 1);
+        try {
+            if (comando == "titulo") {
+                Libro libro;
+                if (imagen->findTitle(argumento, libro)) {
+                    cout << "\n¡Libro encontrado!\n";
+                    cout << "Información completa del libro:\n" << libro << endl;
+                } else {
+                    cout << "\nLibro no encontrado.\n";
+                }
+            } else if (comando == "categoria") {
+                vector<Libro> libros;
+                auto duracion = medirTiempo([&]() {
+                    libros = imagen->booksInGenre(argumento);
+                });
+                if (!libros.empty()) {
+                    cout << "Categoría encontrada: " << argumento << "\n";
+                    cout << "Libros en esta categoría:\n";
+                    for (const Libro& libro : libros) {
+                        cout << libro << "\n";
+                    }
+                } else {
+                    cout << "Categoría no encontrada: " << argumento << "\n";
+                }
+                cout << "Tiempo de búsqueda: " << duracion << " microsegundos\n";
+            } else if (comando == "similares") {
+                vector<pair<Libro, double>> similares = imagen->similar(argumento);
+                if (!similares.empty()) {
+                    cout << "Libros adyacentes a \"" << argumento << "\":" << endl;
+                    for (const auto& vecino : similares) {
+                        cout << " - " << vecino.first.title << " (peso: " << vecino.second << ")" << endl;
+                    }
+                } else {
+                    cout << "El libro \"" << argumento << "\" no tiene libros adyacentes o no esta en el grafo." << endl;
+                }
+            } else if (comando == "guardar") {
+                SegmentedDynamicArray<Libro> libros;
+                fuente(libros);
+                CatalogImage::CommitStats delta = imagen->commit(libros);
+                if (delta.sequence == 0) {
+                    cout << "Sin cambios desde la ultima imagen\n";
+                } else {
+                    cout << "Delta " << delta.sequence << ": " << delta.books << " libros nuevos o cambiados, "
+                         << delta.removed << " eliminados, " << delta.indexEntries << " entradas de indices, "
+                         << delta.rows << " filas de adyacencia, " << delta.bytes << " bytes"
+                         << (delta.compacted ? "; compactado en una base nueva" : "") << "\n";
+                }
+            } else if (comando == "compactar") {
+                auto duracion = medirTiempo([&]() {
+                    imagen->compact();
+                });
+                cout << "Base nueva escrita en " << duracion << " microsegundos\n";
+            } else if (comando == "imagen") {
+                imagen->printMetrics(cout);
+            } else {
+                cout << "Comando desconocido: " << comando << "\n";
+            }
+        } catch (const exception& e) {
+            cout << "Error: " << e.what() << "\n";
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    // Proceso trabajador lanzado por la construcción distribuida del grafo
+    if (argc == 4 && string(argv[1]) == DistributedGraphBuild::WORKER_FLAG) {
+        return DistributedGraphBuild::runWorker(argv[2], atoi(argv[3]));
+    }
+
+    // Opciones: --grafo-externo <directorio> construye el grafo fuera de memoria,
+    //           --memoria-grafo <MB> limita la memoria de esa construcción,
+    //           --checkpoint-grafo <segundos> cada cuánto guarda su avance para poder reanudarla,
+    //           --trabajadores-grafo <N> reparte esa construcción entre N procesos por cubetas de atributos,
+    //           --indice-streaming <directorio> indexa el catálogo por lotes sin cargarlo,
+    //           --lote <libros> y --memoria-indice <MB> ajustan ese modo,
+    //           --ingesta-paralela <hilos> carga el catálogo y construye los árboles en etapas concurrentes,
+    //           --construccion-paralela <hilos> construye los árboles y el grafo a la vez al inicio,
+    //           --carga-perezosa construye cada estructura solo cuando una consulta la necesita,
+    //           --wal <directorio> guarda el catálogo como snapshot + WAL y permite modificarlo,
+    //           --recarga-en-caliente atiende consultas mientras reconstruye el catálogo cuando cambia el CSV,
+    //           --fragmentos <N> reparte el catálogo entre N procesos y consulta a todos por sockets Unix,
+    //           --top-similares <k> limita los similares que devuelven ese modo y el grafo cuantizado,
+    //           --seguidor <directorio> sirve consultas desde una réplica que sigue el WAL de un directorio --wal,
+    //           --retraso-maximo <ms> es el atraso que tolera esa réplica antes de rechazar consultas,
+    //           --grafo-alternativo <variante> responde similares con otra representación del grafo (comprimido, capas, cuantizado),
+    //           --orden-grafo <grado|rcm|atributos> renumera los libros antes de construir el grafo externo,
+    //           --comparar-ordenes mide la localidad del grafo con cada uno de esos órdenes,
+    //           --medir-paginas-grandes <copias> compara páginas normales y de 2 MB en el árbol de títulos y el grafo,
+    //           --imagen <directorio> sirve consultas desde una imagen binaria más deltas (con --wal, del catálogo persistente)
+    string dirGrafoExterno;
+    size_t memoriaGrafoMB = 64;
+    int segundosCheckpoint = 60;
+    int trabajadoresGrafo = 0;
+    string dirIndiceStreaming;
+    size_t lote = 4096;
+    size_t memoriaIndiceMB = 64;
+    int hilosIngesta = 0;
+    int hilosConstruccion = 0;
+    bool perezoso = false;
+    string dirWal;
+    bool recargaEnCaliente = false;
+    int fragmentos = 0;
+    size_t topSimilares = 10;
+    string dirSeguidor;
+    int retrasoMaximo = 1000;
+    string dirImagen;
+    int copiasMedicion = 0;
+    string varianteGrafo;
+    string ordenGrafo;
+    bool compararOrdenes = false;
+    for (int a = 1; a < argc; ++a) {
+        string opcion = argv[a];
+        if (opcion == "--carga-perezosa") {
+            perezoso = true;
+            continue;
+        }
+        if (opcion == "--recarga-en-caliente") {
+            recargaEnCaliente = true;
+            continue;
+        }
+        if (opcion == "--comparar-ordenes") {
+            compararOrdenes = true;
+            continue;
+        }
+        if (a + 1 >= argc) {
+            cerr << "Falta el valor de la opcion " << opcion << endl;
+            return 1;
+        }
+        string valor = argv[++a];
+        // El valor de la opción como entero dentro de [minimo, maximo]
+        auto numero = [&](long long minimo, long long maximo) {
+            size_t fin = 0;
+            long long n = stoll(valor, &fin);
+            if (fin != valor.size() || n < minimo || n > maximo) {
+                throw out_of_range(valor);
+            }
+            return n;
+        };
+        const long long MAXIMO_MB = 1 << 20;
+        const long long MAXIMO_PROCESOS = 1024;
+        try {
+            if (opcion == "--grafo-externo") {
+                dirGrafoExterno = valor;
+            } else if (opcion == "--memoria-grafo") {
+                memoriaGrafoMB = (size_t)numero(1, MAXIMO_MB);
+            } else if (opcion == "--fragmentos") {
+                fragmentos = (int)numero(1, MAXIMO_PROCESOS);
+            } else if (opcion == "--top-similares") {
+                topSimilares = (size_t)numero(1, INT_MAX);
+            } else if (opcion == "--checkpoint-grafo") {
+                segundosCheckpoint = (int)numero(0, INT_MAX);
+            } else if (opcion == "--trabajadores-grafo") {
+                trabajadoresGrafo = (int)numero(1, MAXIMO_PROCESOS);
+            } else if (opcion == "--indice-streaming") {
+                dirIndiceStreaming = valor;
+            } else if (opcion == "--lote") {
+                lote = (size_t)numero(1, INT_MAX);
+            } else if (opcion == "--memoria-indice") {
+                memoriaIndiceMB = (size_t)numero(1, MAXIMO_MB);
+            } else if (opcion == "--ingesta-paralela") {
+                hilosIngesta = (int)numero(1, MAXIMO_PROCESOS);
+            } else if (opcion == "--construccion-paralela") {
+                hilosConstruccion = (int)numero(1, MAXIMO_PROCESOS);
+            } else if (opcion == "--wal") {
+                dirWal = valor;
+            } else if (opcion == "--seguidor") {
+                dirSeguidor = valor;
+            } else if (opcion == "--retraso-maximo") {
+                retrasoMaximo = (int)numero(0, INT_MAX);
+            } else if (opcion == "--imagen") {
+                dirImagen = valor;
+            } else if (opcion == "--orden-grafo") {
+                ordenGrafo = valor;
+            } else if (opcion == "--grafo-alternativo") {
+                varianteGrafo = valor;
+            } else if (opcion == "--medir-paginas-grandes") {
+                copiasMedicion = (int)numero(1, 1000);
+            } else {
+                cerr << "Opcion desconocida: " << opcion << endl;
+                return 1;
+            }
+        } catch (const logic_error&) {
+            cerr << "Valor invalido para la opcion " << opcion << ": " << valor << endl;
+            return 1;
+        }
+    }
+
+    if (!dirIndiceStreaming.empty()) {
+        return ejecutarModoStreaming("libro_superfinal.csv", dirIndiceStreaming, lote, memoriaIndiceMB);
+    }
+
+    if (compararOrdenes) {
+        return ejecutarComparacionOrdenes("libro_superfinal.csv");
+    }
+
+    if (trabajadoresGrafo > 0 && dirGrafoExterno.empty()) {
+        cerr << "--trabajadores-grafo requiere --grafo-externo" << endl;
+        return 1;
+    }
+
+    if (!ordenGrafo.empty()) {
+        if (ordenGrafo != "grado" && ordenGrafo != "rcm" && ordenGrafo != "atributos") {
+            cerr << "Orden de grafo desconocido: " << ordenGrafo << endl;
+            return 1;
+        }
+        if (dirGrafoExterno.empty()) {
+            cerr << "--orden-grafo requiere --grafo-externo" << endl;
+            return 1;
+        }
+        if (hilosIngesta > 0) {
+            cerr << "--orden-grafo renumera los libros al cargarlos y no se puede combinar con --ingesta-paralela" << endl;
+            return 1;
+        }
+    }
+
+    if (!varianteGrafo.empty()) {
+        return ejecutarModoGrafoAlternativo("libro_superfinal.csv", varianteGrafo, topSimilares);
+    }
+
+    if (copiasMedicion > 0) {
+        return ejecutarMedicionPaginasGrandes("libro_superfinal.csv", copiasMedicion);
+    }
+
+    if (recargaEnCaliente) {
+        return ejecutarModoRecarga("libro_superfinal.csv");
+    }
+
+    if (fragmentos > 0) {
+        return ejecutarModoFragmentos("libro_superfinal.csv", fragmentos, topSimilares);
+    }
+
+    if (!dirSeguidor.empty()) {
+        return ejecutarModoSeguidor(dirSeguidor, retrasoMaximo);
+    }
+
+    // Catálogo persistente: se recupera del último snapshot más el WAL y se puede modificar
+    unique_ptr<CatalogStore> almacen;
+    if (!dirWal.empty()) {
+        if (hilosIngesta > 0) {
+            cerr << "--ingesta-paralela lee el CSV original y no se puede combinar con --wal" << endl;
+            return 1;
+        }
+        try {
+            almacen.reset(new CatalogStore(dirWal, "libro_superfinal.csv"));
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        cout << "Catalogo recuperado: " << almacen->booksInSnapshot() << " libros del snapshot, "
+             << almacen->mutationsReplayed() << " mutaciones del WAL, " << almacen->size() << " libros en "
+             << (long long)(almacen->recoveryTime() * 1e6) << " microsegundos\n";
+        editarCatalogo(*almacen);
+    }
+
+    if (!dirImagen.empty()) {
+        return ejecutarModoImagen(dirImagen, [&](SegmentedDynamicArray<Libro>& destino) {
+            if (almacen) {
+                almacen->copyTo(destino);
+            } else {
+                loadDataIntoArray("libro_superfinal.csv", destino);
+            }
+        });
+    }
+
+    // Arreglo segmentado: los libros no se mueven al crecer, las referencias siguen siendo válidas
+    SegmentedDynamicArray<Libro> libros_final;
+    // Los nodos del árbol de títulos salen de bloques de 2 MB (ver --medir-paginas-grandes)
+    KeyValueAVLTree<std::string, int, HugePageAllocation> avl;
+    KeyValueAVLTree<string, unordered_map<int, Libro>> tree;
+
+    double threshold = 0.6;
+    Graph grafo;
+    unique_ptr<MappedCsrGraph> grafoCsr;
+    BackgroundBuild* progresoGrafo = nullptr;
+
+    // `progreso` recibe los pares de libros comparados, puede ser nulo
+    auto construirGrafo = [&](BackgroundBuild* progreso) {
+        size_t n = libros_final.size();
+        if (progreso) {
+            progreso->setTotal((unsigned long long)n * (n - 1) / 2);
+        }
+
+        if (!dirGrafoExterno.empty() && trabajadoresGrafo > 0) {
+            // Cada trabajador puntúa los pares de sus cubetas y escribe particiones ordenadas; el
+            // coordinador las mezcla en el mismo CSR que la construcción en un solo proceso
+            DistributedGraphBuild distribuido(dirGrafoExterno, trabajadoresGrafo, memoriaGrafoMB << 20);
+            string archivoCsr = dirGrafoExterno + "/grafo.csr";
+            distribuido.run(libros_final, threshold, archivoCsr);
+            distribuido.printMetrics(cout);
+            if (progreso) {
+                progreso->advance((unsigned long long)n * (n - 1) / 2);
+            }
+            grafoCsr.reset(new MappedCsrGraph(archivoCsr));
+            return;
+        }
+
+        if (!dirGrafoExterno.empty()) {
+            // Construcción fuera de memoria: las aristas se ordenan en disco y se escribe el CSR directamente
+            // Cada bloque de filas terminado se guarda en disco; si el proceso se interrumpe, la
+            // siguiente ejecución con el mismo catálogo y umbral continúa desde el último checkpoint
+            ExternalGraphBuilder constructor(dirGrafoExterno, memoriaGrafoMB << 20);
+            unsigned long long huella = rowChecksum(to_string(threshold));
+            for (size_t i = 0; i < n; ++i) {
+                huella = (huella ^ rowChecksum(formatLibro(libros_final[i]))) * 1099511628211ull;
+            }
+            size_t inicio = (size_t)min<unsigned long long>(constructor.resume(huella), n);
+            if (inicio > 0) {
+                cout << "Reanudando el grafo desde el libro " << inicio << " de " << n << endl;
+                if (progreso) {
+                    progreso->advance((unsigned long long)inicio * (n - 1) - (unsigned long long)inicio * (inicio - 1) / 2);
+                }
+            }
+
+            auto ultimoCheckpoint = chrono::steady_clock::now();
+            for (size_t i = inicio; i < n; ++i) {
+                for (size_t j = i + 1; j < n; ++j) {
+                    double similarity = calculateSimilarity(libros_final[i], libros_final[j]);
+                    if (similarity >= threshold) {
+                        constructor.addEdge(i, j, 1.0 - similarity);
+                    }
+                }
+                if (progreso) {
+                    progreso->advance(n - 1 - i);
+                }
+                if (chrono::steady_clock::now() - ultimoCheckpoint >= chrono::seconds(segundosCheckpoint)) {
+                    constructor.checkpoint(i + 1);
+                    ultimoCheckpoint = chrono::steady_clock::now();
+                }
+            }
+            string archivoCsr = dirGrafoExterno + "/grafo.csr";
+            constructor.finish(archivoCsr, libros_final.size());
+            grafoCsr.reset(new MappedCsrGraph(archivoCsr));
+            return;
+        }
+
+        for (size_t i = 0; i < libros_final.size(); ++i) {
+            for (size_t j = i + 1; j < libros_final.size(); ++j) {
+                double similarity = calculateSimilarity(libros_final[i], libros_final[j]);
+                if (similarity >= threshold) {
+                    double weight = 1.0 - similarity;
+                    grafo.addEdge(libros_final[i].title, libros_final[j].title, weight);
+                }
+            }
+            if (progreso) {
+                progreso->advance(n - 1 - i);
+            }
+        }
+    };
+
+    // Cada estructura se construye una sola vez, la primera vez que se necesita; en modo perezoso
+    // se informa el tiempo de cada una para ver qué costó el arranque de la consulta
+    ostream* registroArranque = perezoso ? &cout : nullptr;
+    LazyIndex catalogo("catalogo", [&]() {
+        if (almacen) {
+            almacen->copyTo(libros_final);
+        } else {
+            loadDataIntoArray("libro_superfinal.csv", libros_final);
+        }
+        if (!ordenGrafo.empty()) {
+            // Todas las estructuras se indexan por posición, así que se renumera antes de construir
+            // cualquiera; los vecinos quedan cerca en el CSR
+            BucketSimilarityGraph vecindad;
+            vecindad.build(libros_final);
+            permuteBooks(libros_final, calcularOrden(ordenGrafo, libros_final, vecindad));
+        }
+    }, registroArranque);
+    LazyIndex indiceTitulos("arbol de titulos", [&]() {
+        // Insertar los libros en el árbol AVL
+        for (int i = 0; i < libros_final.size(); i++) {
+            avl.insert(libros_final[i].title, i); // Clave: nombre del libro, Valor: índice
+        }
+    }, registroArranque, {&catalogo});
+    LazyIndex indiceCategorias("arbol de categorias", [&]() {
+        construirAVLDeCategorias(libros_final, tree);
+    }, registroArranque, {&catalogo});
+    LazyIndex indiceGrafo("grafo de similitud", [&]() {
+        construirGrafo(progresoGrafo);
+    }, registroArranque, {&catalogo});
 
-    DynamicArray<Libro> libros_final;
-    loadDataIntoArray("libro_superfinal.csv", libros_final);
+    // Las construcciones corren en otros hilos y sus excepciones se relanzan al esperarlas; se
+    // informan como las de los demás cargadores y el programa termina
+    auto preparar = [](const function<void()>& paso) {
+        try {
+            paso();
+            return true;
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            return false;
+        }
+    };
 
-    auto start_creation = std::chrono::high_resolution_clock::now();
-    KeyValueAVLTree<std::string, int> avl;
+    if (perezoso) {
+        // Nada se construye hasta la primera consulta
+    } else if (hilosIngesta > 0) {
+        // Lectura, análisis y construcción de los árboles se solapan; cada árbol tiene su propio hilo
+        IngestPipeline ingesta("libro_superfinal.csv", libros_final, hilosIngesta);
+        ingesta.addIndexBuilder("arbol de titulos", [&](const IngestedBook& libro) {
+            avl.insert(libros_final[libro.index].title, libro.index);
+        });
+        // El nodo de cada categoría se busca una sola vez, con el id del género como índice
+        vector<KeyValueAVLNode<string, unordered_map<int, Libro>>*> nodoDeGenero;
+        ingesta.addIndexBuilder("arbol de categorias", [&](const IngestedBook& libro) {
+            if (libro.genre >= nodoDeGenero.size()) {
+                nodoDeGenero.resize(libro.genre + 1, nullptr);
+            }
+            auto*& nodo = nodoDeGenero[libro.genre];
+            if (nodo) {
+                nodo->value[libro.index] = libros_final[libro.index];
+            } else {
+                agregarLibroACategoria(libros_final, libro.index, tree);
+                nodo = tree.find(libros_final[libro.index].genre);
+            }
+        });
+        try {
+            ingesta.run();
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        ingesta.printMetrics(cout);
+        catalogo.markBuilt();
+        indiceTitulos.markBuilt();
+        indiceCategorias.markBuilt();
+    } else if (hilosConstruccion > 0) {
+        // Los dos árboles y el grafo solo dependen del arreglo cargado, así que se construyen a la vez
+        ThreadPool pool(hilosConstruccion);
+        TaskGraph tareas;
+        int carga = tareas.addTask(catalogo.label(), [&]() { catalogo.ensure(); });
+        tareas.addTask(indiceTitulos.label(), [&]() { indiceTitulos.ensure(); }, {carga});
+        tareas.addTask(indiceCategorias.label(), [&]() { indiceCategorias.ensure(); }, {carga});
+        tareas.addTask(indiceGrafo.label(), [&]() { indiceGrafo.ensure(); }, {carga});
+        if (!preparar([&]() { tareas.run(pool); })) {
+            return 1;
+        }
+        cout << "Construccion en paralelo con " << pool.size() << " hilos:\n";
+        tareas.printTimings(cout);
+    } else {
+        if (!preparar([&]() { indiceTitulos.ensure(); })) {
+            return 1;
+        }
+        std::cout << "Tiempo para construir el arbol de busqueda: " << indiceTitulos.seconds() << " segundos\n";
+    }
 
-    // Insertar los libros en el árbol AVL
-    for (int i = 0; i < libros_final.size(); i++) {
-        avl.insert(libros_final[i].title, i); // Clave: nombre del libro, Valor: índice
+    // Lo que falta se construye en segundo plano mientras el usuario consulta; cada consulta
+    // espera solo por la estructura que necesita
+    unique_ptr<BackgroundBuild> fondoCategorias;
+    unique_ptr<BackgroundBuild> fondoGrafo;
+    if (!perezoso && !indiceCategorias.built()) {
+        fondoCategorias.reset(new BackgroundBuild(indiceCategorias.label(), [&](BackgroundBuild&) {
+            indiceCategorias.ensure();
+        }));
+    }
+    if (!perezoso && !indiceGrafo.built()) {
+        fondoGrafo.reset(new BackgroundBuild(indiceGrafo.label(), [&](BackgroundBuild& progreso) {
+            progresoGrafo = &progreso;
+            indiceGrafo.ensure();
+        }));
     }
-    auto end_creation = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> creation_duration = end_creation - start_creation;
-    std::cout << "Tiempo para construir el arbol de busqueda: " << creation_duration.count() << " segundos\n";
 
     std::string book_name;
     std::cout << "Ingrese el título del libro que desea buscar: ";
     std::getline(std::cin, book_name);
+    if (!preparar([&]() { indiceTitulos.ensure(); })) {
+        return 1;
+    }
 
     try {
         // Intentar encontrar el nodo exacto
@@ -161,51 +1300,69 @@ int main() {
             } else {
                 std::cout << "\nNo se encontró ningún nodo cercano." << std::endl;
             }
+
+            // Lista corta de títulos vecinos en orden alfabético ("quizás quiso decir")
+            auto start_neighbors = std::chrono::high_resolution_clock::now();
+            auto vecinos = avl.neighbors(book_name, 5);
+            auto end_neighbors = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> neighbors_duration = end_neighbors - start_neighbors;
+
+            if (!vecinos.empty()) {
+                std::cout << "\nQuizás quiso decir:\n";
+                for (const auto* vecino : vecinos) {
+                    std::cout << " - " << vecino->key << " (índice: " << vecino->value << ")\n";
+                }
+            }
+            std::cout << "Busqueda de titulos vecinos: " << neighbors_duration.count() << " segundos\n";
         }
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
     }
 
      // Parte 2: Crear el árbol AVL para gestionar categorías de libros
-    KeyValueAVLTree<string, unordered_map<int, Libro>> tree;
-
-    // Insertar los libros en el árbol AVL
-    auto tiempoConstruccion = medirTiempo([&]() {
-        construirAVLDeCategorias(libros_final, tree);
-    });
-    cout << "Tiempo para construir el árbol AVL: " << tiempoConstruccion << " microsegundos\n";
+    if (fondoCategorias) {
+        if (!preparar([&]() { fondoCategorias->wait(cout); })) {
+            return 1;
+        }
+        cout << "Tiempo para construir el árbol AVL: " << (long long)(fondoCategorias->seconds() * 1e6) << " microsegundos\n";
+    }
 
     // Menú para buscar categorías
     while (true) {
         string categoria;
+        if (fondoGrafo && !fondoGrafo->ready()) {
+            cout << "\n[" << fondoGrafo->label() << ": " << (int)(fondoGrafo->progress() * 100) << "% construido]";
+        }
         cout << "\nIngrese la categoría que desea buscar (o escriba 'salir' para terminar): ";
-        getline(cin, categoria);
 
-        if (categoria == "salir") {
+        if (!getline(cin, categoria) || categoria == "salir") {
             break;
         }
 
-        buscarPorCategoria(categoria, tree);
-    }
-
-    double threshold = 0.6;
-    Graph grafo;
-
-    for (size_t i = 0; i < libros_final.size(); ++i) {
-        for (size_t j = i + 1; j < libros_final.size(); ++j) {
-            double similarity = calculateSimilarity(libros_final[i], libros_final[j]);
-            if (similarity >= threshold) {
-                double weight = 1.0 - similarity;
-                grafo.addEdge(libros_final[i].title, libros_final[j].title, weight);
-            }
+        if (!preparar([&]() { indiceCategorias.ensure(); })) {
+            return 1;
         }
+        buscarPorCategoria(categoria, tree);
     }
 
     string titulo;
     cout << "Nombre del libro que te interesa para ver sus similares: ";
-    getline(cin, titulo);
-    grafo.displayAdjacent(titulo);
-
+    if (!getline(cin, titulo)) {
+        return 0;
+    }
+    if (!preparar([&]() {
+            if (fondoGrafo) {
+                fondoGrafo->wait(cout);
+            }
+            indiceGrafo.ensure();
+        })) {
+        return 1;
+    }
+    if (grafoCsr) {
+        mostrarAdyacentes(titulo, avl, libros_final, *grafoCsr);
+    } else {
+        grafo.displayAdjacent(titulo);
+    }
 
     return 0;
 }